@@ -0,0 +1,165 @@
+#pragma once
+
+#include <buffer_pool.hpp>
+#include <precise.hpp>
+#include <render_job.hpp>
+#include <threadpool.hpp>
+#include <trace.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <iosfwd>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/// A view of a zoom animation that the frames in between are interpolated
+/// from
+struct Keyframe {
+    int frame;
+    PrecisePoint center;
+    double scale;  // pixels per world unit
+    int max_iters;
+};
+
+/// Keyframes, one per line as "FRAME X Y SCALE MAX_ITERS". Centres take any
+/// number of digits; blank lines and lines starting with '#' are skipped.
+/// Throws std::invalid_argument on a malformed line, and unless the first
+/// keyframe is frame 0 and frames increase.
+std::vector<Keyframe> parse_keyframes(std::istream& is);
+
+/// Where one frame of an animation looks
+struct FrameView {
+    PrecisePoint center;
+    double scale;
+    int max_iters;
+};
+
+/// One view per frame up to the last keyframe's. Between two keyframes the
+/// scale changes geometrically, so the zoom runs at a constant rate, while
+/// the centre of the deeper one moves across the screen at a constant speed
+/// and max_iters changes linearly.
+std::vector<FrameView> interpolate_keyframes(std::span<Keyframe const> keys);
+
+/// Viewport of a w x h frame centred on view.center
+Viewport frame_viewport(FrameView const& view, int w, int h);
+
+/// Where rendered frames go. encode may run on several threads at once;
+/// write is called on the rendering thread, in frame order.
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+    /// The bytes to store for a frame of 8-bit RGB pixels
+    virtual std::string encode(std::span<std::uint8_t const> rgb, int w, int h) const = 0;
+    virtual void write(int frame, std::string const& bytes) = 0;
+};
+
+enum class ImageFormat : int {
+    PPM,
+    PNG,
+};
+
+/// One image file per frame, named by replacing the run of '#' in the
+/// pattern with the zero-padded frame number, e.g. zoom_#####.png
+class ImageFiles final : public FrameSink {
+    std::string pattern;
+    ImageFormat format;
+
+public:
+    /// Throws std::invalid_argument when the pattern has no '#', or for PNG
+    /// in builds without libpng
+    ImageFiles(std::string pattern, ImageFormat format);
+
+    std::string path(int frame) const;
+    std::string encode(std::span<std::uint8_t const> rgb, int w, int h) const override;
+    void write(int frame, std::string const& bytes) override;
+};
+
+/// A YUV4MPEG2 stream in 4:2:0, as ffmpeg and x264 read from a pipe
+class Y4mStream final : public FrameSink {
+    std::ostream& os;
+    int width, height, fps;
+    bool header_written = false;
+
+public:
+    /// Throws std::invalid_argument unless w and h are even
+    Y4mStream(std::ostream& out, int w, int h, int frames_per_second);
+
+    std::string encode(std::span<std::uint8_t const> rgb, int w, int h) const override;
+    void write(int frame, std::string const& bytes) override;
+};
+
+/// Render w x h frames of `views` into `sink`. Each frame is computed on
+/// the pool while up to depth - 1 earlier ones are coloured and encoded as
+/// BACKGROUND tasks, which run on whatever the computation leaves idle.
+/// make_job(viewport, max_iters) builds the engine's job. Returns once
+/// every frame is written, or rethrows the first error after the frames in
+/// flight are finished.
+template<class Engine, class MakeJob>
+void render_animation(ThreadPool& tpool, std::span<FrameView const> views, int w,
+                      int h, MakeJob const& make_job, FrameSink& sink, int depth) {
+    using Job    = std::invoke_result_t<MakeJob const&, Viewport const&, int>;
+    using Result = decltype(std::declval<Engine&>().escape_times(std::declval<Job const&>()));
+
+    // A frame in flight. Each has its own colouring engine, since engines
+    // keep per-call state and the slots colour concurrently.
+    struct Slot {
+        Engine colorist;
+        std::optional<Job> job;
+        Result result;
+        FrameBuffer<std::uint8_t> rgb;
+        std::future<std::string> encoded;  // valid while in flight
+        int frame = 0;
+
+        explicit Slot(ThreadPool& pool): colorist(pool) {}
+    };
+
+    Engine engine(tpool);
+    std::deque<Slot> slots;
+    for (int k = 0; k < std::max(depth, 2); ++k) slots.emplace_back(tpool);
+
+    auto retire = [&](Slot& s) {
+        if (!s.encoded.valid()) return;
+        std::string const bytes = s.encoded.get();
+        sink.write(s.frame, bytes);
+        engine.recycle(std::move(s.result));
+    };
+
+    TaskOptions const background{.priority = TaskPriority::BACKGROUND};
+    int const n = views.size();
+    try {
+        for (int i = 0; i < n; ++i) {
+            Slot& s = slots[i % slots.size()];
+            retire(s);
+            s.job = make_job(frame_viewport(views[i], w, h), views[i].max_iters);
+            {
+                trace::Span span("compute", trace::phase);
+                s.result = engine.escape_times(*s.job);
+            }
+            s.frame   = i;
+            s.encoded = tpool.queue(background, [&s, &sink, w, h] {
+                resize_untouched(s.rgb, 3ull * w * h);
+                {
+                    trace::Span span("colorize", trace::phase);
+                    s.colorist.colorize(*s.job, s.result, s.rgb.data(), 3 * w);
+                }
+                if constexpr (requires { s.colorist.antialias(*s.job, s.result, nullptr, 0); }) {
+                    trace::Span span("antialias", trace::phase);
+                    s.colorist.antialias(*s.job, s.result, s.rgb.data(), 3 * w);
+                }
+                trace::Span span("encode", trace::phase);
+                return sink.encode(s.rgb, w, h);
+            });
+        }
+        for (int i = std::max(n - int(slots.size()), 0); i < n; ++i)
+            retire(slots[i % slots.size()]);
+    } catch (...) {
+        // The tasks still running use the slots
+        for (Slot& s : slots) {
+            if (s.encoded.valid()) s.encoded.wait();
+        }
+        throw;
+    }
+}
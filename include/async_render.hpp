@@ -0,0 +1,251 @@
+#pragma once
+
+#include <buffer_pool.hpp>
+#include <palette.hpp>
+#include <render_job.hpp>
+#include <threadpool.hpp>
+#include <trace.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// Image published by an AsyncRenderer, in the pixel layout of a Cairo RGB24
+/// image surface so presenting it is a plain copy
+struct RenderedFrame {
+    Viewport viewport;
+    int width  = 0;
+    int height = 0;
+    FrameBuffer<argb32> pixels;  // rows of width words
+    /// Rows [dirty_y1, dirty_y2) changed since the last AsyncRenderer::consume
+    int dirty_y1 = 0;
+    int dirty_y2 = 0;
+    /// False while only the preview or part of the final rows are in
+    bool complete    = false;
+    double render_ms = 0;
+    /// trace::now_ns() when the frame started, for trace::summarize
+    std::int64_t started_ns = 0;
+    /// Why the last requested job failed, empty once a later one publishes.
+    /// The pixels are still those of the last publication.
+    std::string error;
+};
+
+/// Renders frames on a background thread so the caller never waits on a
+/// kernel. Each frame is published first as a coarse preview and then band by
+/// band at full resolution; requesting a new frame cancels the one in flight.
+template<class Engine, class Job>
+class AsyncRenderer {
+public:
+    /// Preview pixels span preview_factor x preview_factor final pixels
+    static constexpr int preview_factor = 8;
+    /// Height of the bands published during the full-resolution pass
+    static constexpr int band_rows = 64;
+
+    /// `on_update` runs on the render thread after every publication
+    AsyncRenderer(ThreadPool& pool, std::function<void()> on_update)
+        : tpool(pool), engine(pool), preview(pool), notify(std::move(on_update)),
+          worker([this](std::stop_token st) { run(st); }) {}
+
+    ~AsyncRenderer() {
+        {
+            std::lock_guard g(job_mtx);
+            frame_stop.request_stop();
+        }
+        worker.request_stop();
+        worker.join();
+    }
+
+    AsyncRenderer(AsyncRenderer const&)            = delete;
+    AsyncRenderer& operator=(AsyncRenderer const&) = delete;
+
+    /// Start rendering `job`, abandoning any earlier one still in flight
+    void request(Job job) {
+        std::lock_guard g(job_mtx);
+        frame_stop.request_stop();
+        pending = std::move(job);
+        wake.notify_one();
+    }
+
+    /// Call f(RenderedFrame const&) with the latest frame and clear its
+    /// dirty rows. Meant for the GUI thread after `on_update` fired.
+    template<class F>
+    void consume(F&& f) {
+        std::lock_guard g(frame_mtx);
+        f(std::as_const(frame));
+        frame.dirty_y1 = frame.dirty_y2 = 0;
+    }
+
+private:
+    using Pixel = typename decltype(std::declval<Engine&>().escape_times(
+        std::declval<Job const&>()))::value_type;
+
+    ThreadPool& tpool;
+    Engine engine;
+    // Kept apart so previews do not evict the frame `engine` reuses on pans
+    Engine preview;
+    std::function<void()> notify;
+
+    std::mutex job_mtx;
+    std::condition_variable_any wake;
+    std::optional<Job> pending;
+    std::stop_source frame_stop;
+
+    std::mutex frame_mtx;
+    RenderedFrame frame;
+
+    // Render-thread images, copied into `frame` as rows are finished. Kept
+    // between frames so they only reallocate when the view grows, and then
+    // filled in by the workers so their pages spread over the NUMA nodes.
+    FrameBuffer<argb32> canvas;
+    FrameBuffer<argb32> preview_canvas;
+    std::int64_t started_ns = 0;  // of the frame being rendered
+
+    std::jthread worker;
+
+    void run(std::stop_token st) {
+        trace::name_thread("render");
+        while (true) {
+            std::unique_lock lock(job_mtx);
+            if (!wake.wait(lock, st, [this] { return pending.has_value(); }))
+                return;
+            Job const job = std::move(*pending);
+            pending.reset();
+            frame_stop = std::stop_source();
+            std::stop_token const stop = frame_stop.get_token();
+            lock.unlock();
+
+            try {
+                render(job, stop);
+            } catch (render_cancelled const&) {
+                // A newer job is pending
+            } catch (std::exception const& e) {
+                fail(e.what());
+            }
+        }
+    }
+
+    void render(Job const& job, std::stop_token const& stop) {
+        auto const beg = std::chrono::steady_clock::now();
+        started_ns     = trace::now_ns();
+        int const w    = job.width;
+        int const h    = job.height;
+        resize_untouched(canvas, std::size_t(w) * h);
+
+        // A pan only computes the exposed strips, faster than any preview
+        if (!engine.can_reuse(job)) render_preview(job, stop);
+
+        RenderControl<Pixel> ctl{
+            .stop = stop,
+            .rows_done =
+                [&](std::span<Pixel const> rows, int y1, int y2) {
+                    Job band    = job;
+                    band.height = y2 - y1;
+                    colorize_into(engine, band, rows, canvas.data() + std::size_t(w) * y1, w);
+                    publish(job, y1, y2, false, 0);
+                },
+            .bands = (h + band_rows - 1) / band_rows,
+        };
+        FrameBuffer<Pixel> result;
+        {
+            trace::Span span("compute", trace::phase);
+            result = engine.escape_times(job, ctl);
+        }
+
+        bool const recolor = Engine::colors_need_whole_frame(job);
+        if (recolor) colorize_into(engine, job, result, canvas.data(), w);
+        engine.recycle(std::move(result));
+        std::chrono::duration<double, std::milli> const et =
+            std::chrono::steady_clock::now() - beg;
+        publish(job, 0, recolor ? h : 0, true, et.count());
+    }
+
+    void render_preview(Job const& job, std::stop_token const& stop) {
+        int const w = job.width;
+        int const h = job.height;
+        int const f = preview_factor;
+
+        // Ahead of any background work sharing the pool
+        ThreadPool::PriorityScope urgent(TaskPriority::INTERACTIVE);
+        trace::Span span("preview", trace::phase);
+
+        Job coarse            = job;
+        coarse.width          = (w + f - 1) / f;
+        coarse.height         = (h + f - 1) / f;
+        coarse.viewport.scale = job.viewport.scale / f;
+
+        auto iters = preview.escape_times(coarse, {.stop = stop});
+        resize_untouched(preview_canvas, std::size_t(coarse.width) * coarse.height);
+        colorize_into(preview, coarse, iters, preview_canvas.data(), coarse.width);
+        preview.recycle(std::move(iters));
+
+        tpool.parallel_for(0, h, [&](int y1, int y2) {
+            for (int y = y1; y < y2; ++y) {
+                argb32 const* src = preview_canvas.data() + std::size_t(y / f) * coarse.width;
+                argb32* dst       = canvas.data() + std::size_t(y) * w;
+                for (int x = 0; x < w; ++x) dst[x] = src[x / f];
+            }
+        }, 16);
+        if (stop.stop_requested()) throw render_cancelled();
+        publish(job, 0, h, false, 0);
+    }
+
+    /// Colour `pixels` with `with` into rows of `stride` words
+    static void colorize_into(Engine& with, Job const& job,
+                              std::span<Pixel const> pixels, argb32* out,
+                              int stride) {
+        trace::Span span("colorize", trace::phase);
+        with.colorize(job, pixels, reinterpret_cast<std::uint8_t*>(out),
+                      stride * int(sizeof(argb32)), PixelFormat::ARGB32);
+    }
+
+    /// Copy canvas rows [y1, y2) into the shared frame and notify
+    void publish(Job const& job, int y1, int y2, bool complete, double ms) {
+        {
+            trace::Span span("publish", trace::phase);
+            std::lock_guard g(frame_mtx);
+            if (frame.width != job.width || frame.height != job.height) {
+                // Only the first publication of a job can change the size,
+                // and it always covers the whole frame
+                frame.width  = job.width;
+                frame.height = job.height;
+                frame.pixels.resize(canvas.size());
+            }
+            frame.viewport  = job.viewport;
+            frame.complete  = complete;
+            frame.render_ms = ms;
+            frame.started_ns = started_ns;
+            frame.error.clear();
+
+            std::size_t const row = job.width;
+            std::copy(canvas.begin() + y1 * row, canvas.begin() + y2 * row,
+                      frame.pixels.begin() + y1 * row);
+            if (y1 < y2) {
+                bool const clean = frame.dirty_y1 == frame.dirty_y2;
+                frame.dirty_y1   = clean ? y1 : std::min(frame.dirty_y1, y1);
+                frame.dirty_y2   = clean ? y2 : std::max(frame.dirty_y2, y2);
+            }
+        }
+        if (notify) notify();
+    }
+
+    /// Report why the current job failed and keep serving requests
+    void fail(std::string what) {
+        {
+            std::lock_guard g(frame_mtx);
+            frame.complete = false;
+            frame.error    = std::move(what);
+        }
+        if (notify) notify();
+    }
+};
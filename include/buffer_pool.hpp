@@ -0,0 +1,112 @@
+#pragma once
+
+#include <topology.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// std::allocator that default-initialises instead of value-initialising,
+/// so resizing a vector of ints or pixels writes nothing and each page is
+/// first touched by whoever fills it
+template<class T>
+struct UntouchedAllocator : std::allocator<T> {
+    template<class U>
+    struct rebind {
+        using other = UntouchedAllocator<U>;
+    };
+
+    UntouchedAllocator() = default;
+    template<class U>
+    UntouchedAllocator(UntouchedAllocator<U> const&) noexcept {}
+
+    template<class U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+        ::new (static_cast<void*>(p)) U;
+    }
+    template<class U, class... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+/// A frame's worth of escape times or pixels. Growing it leaves the new
+/// elements uninitialised.
+template<class T>
+using FrameBuffer = std::vector<T, UntouchedAllocator<T>>;
+
+/// A buffer of n elements, contents unspecified, whose pages are placed by
+/// the threads that first write them, on their own NUMA node, rather than
+/// by the caller. Pages malloc hands back from earlier use are released
+/// first, so they fault in afresh on the writers too.
+template<class T>
+FrameBuffer<T> untouched_buffer(std::size_t n) {
+    FrameBuffer<T> buf(n);
+    release_pages(buf.data(), n * sizeof(T));
+    return buf;
+}
+
+/// Resize `buf` to n elements. When that takes a larger allocation the
+/// contents are lost and the new pages are left to the threads writing
+/// them, as with untouched_buffer.
+template<class T>
+void resize_untouched(FrameBuffer<T>& buf, std::size_t n) {
+    if (n > buf.capacity())
+        buf = untouched_buffer<T>(n);
+    else
+        buf.resize(n);
+}
+
+/// Frame-sized buffers handed back after use and taken again for the next
+/// frame. A recycled buffer keeps its pages, so steady-state rendering
+/// neither allocates nor faults in fresh memory, and buffers only grow when
+/// the frame does. New buffers leave their pages to the workers
+/// filling them in. Not thread-safe; each engine keeps its own.
+template<class T>
+class BufferPool {
+    std::vector<FrameBuffer<T>> free;
+
+public:
+    /// Buffers kept beyond this drop the smallest
+    static constexpr std::size_t max_free = 8;
+
+    /// A buffer of n elements. Contents are unspecified: whatever the
+    /// buffer held last, or nothing written yet where it had to grow.
+    FrameBuffer<T> take(std::size_t n) {
+        // The smallest buffer with room, preferring ones already holding n
+        // elements so resizing writes nothing
+        auto best  = free.end();
+        auto score = [n](FrameBuffer<T> const& b) {
+            return std::pair(b.size() < n, b.capacity());
+        };
+        for (auto it = free.begin(); it != free.end(); ++it) {
+            if (it->capacity() < n) continue;
+            if (best == free.end() || score(*it) < score(*best)) best = it;
+        }
+        if (best == free.end()) return untouched_buffer<T>(n);
+
+        std::swap(*best, free.back());
+        FrameBuffer<T> buf = std::move(free.back());
+        free.pop_back();
+        buf.resize(n);
+        return buf;
+    }
+
+    void give(FrameBuffer<T>&& buf) {
+        if (buf.capacity() == 0) return;
+        free.push_back(std::move(buf));
+        if (free.size() > max_free) {
+            auto smallest = free.begin();
+            for (auto it = free.begin(); it != free.end(); ++it) {
+                if (it->capacity() < smallest->capacity()) smallest = it;
+            }
+            std::swap(*smallest, free.back());
+            free.pop_back();
+        }
+    }
+
+    std::size_t size() const { return free.size(); }
+};
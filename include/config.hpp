@@ -37,7 +37,7 @@ public:
 };
 
 inline RGB get_color_for_hue(double hue) {
-    assert(0 <= hue <= 1);
+    assert(0 <= hue && hue <= 1);
     static Palette pl;
 
     return pl[hue];
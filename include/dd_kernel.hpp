@@ -0,0 +1,199 @@
+#pragma once
+
+// The double-double line kernel, written once against a small set of vector
+// operations. Each kernels_dd_*.cpp supplies them for its instruction set
+// and instantiates dd_render_line. Those files, like simd_kernels.cpp, are
+// compiled with -ffp-contract=off: the error-free transforms rely on every
+// product and sum being rounded exactly where it is written, which a fused
+// multiply-add the compiler slips in breaks.
+
+#include <line_kernel.hpp>
+
+namespace {
+
+/// Orbits that come back this close to an earlier point are periodic: below
+/// the pixel spacing of any view double-double is used for, at least 2^-99
+/// (see MandelbrotEngine::kernel_precision), and far above its rounding
+/// errors for |z| <= 2
+constexpr double period_epsilon_dd = 1e-30;
+/// Only points this far inside the main bulbs skip iterating, since the test
+/// runs on the high parts
+constexpr double bulb_margin_dd = 1e-12;
+
+/// Pixels of a line handed out one by one to the lanes, as LineQueue
+struct DdLineQueue {
+    int* pline;
+    DoubleDouble x1;
+    double step;
+    DoubleDouble cy;
+    int linew, maxiters;
+    int next = 0;
+    int live = 0;  // lanes holding a pixel
+
+    /// Next pixel that needs iterating, or -1. Pixels in the main bulbs are
+    /// written on the way.
+    int pop(DoubleDouble& cx) {
+        for (; next < linew; ++next) {
+            cx = x1 + step * next;
+            if (!in_main_bulbs(cx.hi, cy.hi, bulb_margin_dd)) return next++;
+            pline[next] = maxiters;
+        }
+        return -1;
+    }
+};
+
+/// Lanes of N double-double orbits. Iterations are counted in doubles, which
+/// are exact far beyond any maxiters and need no integer compares.
+template<class Ops>
+struct DdLanes {
+    typename Ops::V xh, xl, yh, yl, cxh, cxl;
+    typename Ops::V xsh, xsl, ysh, ysl;  // point saved for the cycle detection
+    typename Ops::V n, save_at;
+};
+
+/// refill for double-double lanes
+template<class Ops>
+[[gnu::noinline]] DdLanes<Ops> dd_refill(DdLanes<Ops> s, int lanes, int* pixel, int& alive,
+                                        DdLineQueue& q) {
+    constexpr int N      = Ops::N;
+    constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+    constexpr double low = std::numeric_limits<double>::lowest();
+    constexpr int fields = sizeof(s) / sizeof(s.xh);
+    static_assert(sizeof(s.xh) == N * sizeof(double));
+
+    // Field f of lane l at v[f][l]
+    alignas(sizeof(s.xh)) double v[fields][N];
+    std::memcpy(v, &s, sizeof v);
+    enum { XH, XL, YH, YL, CXH, CXL, XSH, XSL, YSH, YSL, NS, SAVE_AT };
+    constexpr int orbit[] = {XH, XL, YH, YL, XSH, XSL, YSH, YSL};
+    for (int l = 0; l < N; ++l) {
+        if (!(lanes >> l & 1)) continue;
+        if (int const p = pixel[l]; p >= 0) {
+            q.pline[p] = static_cast<int>(v[NS][l]);
+            --alive;
+            --q.live;
+        }
+        DoubleDouble c;
+        pixel[l]        = q.pop(c);
+        bool const used = pixel[l] >= 0;
+        alive  += used;
+        q.live += used;
+        double const start = used ? 0 : nan;
+        for (int f : orbit) v[f][l] = start;
+        v[CXH][l]     = c.hi;
+        v[CXL][l]     = c.lo;
+        v[NS][l]      = used ? 0 : low;
+        v[SAVE_AT][l] = 1;
+    }
+    std::memcpy(&s, v, sizeof v);
+    return s;
+}
+
+/// (h, l) = (ah, al) + (bh, bl). Two-sum of the high parts with the low
+/// parts added to its error: accurate relative to |a| + |b|, which keeps
+/// the absolute error of orbits with |z| <= 2 near 2^-104.
+template<class Ops, class V>
+inline void dd_add(V ah, V al, V bh, V bl, V& h, V& l) {
+    V const s  = Ops::add(ah, bh);
+    V const bb = Ops::sub(s, ah);
+    V const e  = Ops::add(Ops::add(Ops::sub(ah, Ops::sub(s, bb)), Ops::sub(bh, bb)),
+                          Ops::add(al, bl));
+    h = Ops::add(s, e);
+    l = Ops::sub(e, Ops::sub(h, s));
+}
+
+/// (h, l) = (ah, al) - (bh, bl), as dd_add
+template<class Ops, class V>
+inline void dd_sub(V ah, V al, V bh, V bl, V& h, V& l) {
+    V const s  = Ops::sub(ah, bh);
+    V const bb = Ops::sub(s, ah);
+    V const e  = Ops::add(Ops::sub(Ops::sub(ah, Ops::sub(s, bb)), Ops::add(bh, bb)),
+                          Ops::sub(al, bl));
+    h = Ops::add(s, e);
+    l = Ops::sub(e, Ops::sub(h, s));
+}
+
+/// The double-double line kernel on Ops::N lanes per vector, `groups`
+/// vectors interleaved to hide latency. Ops provides, on vectors V of
+/// doubles and lane masks M: set1, add, sub, mul, abs, prod_error(a, b, p)
+/// = a * b - p exactly for p the rounded a * b, gt, lt, eq, both, either,
+/// select(m, a, b) taking a where m is set, and bits(m) with lane l at bit l.
+template<class Ops, int groups>
+void dd_render_line(int* const __restrict pline, DoubleDouble const x1,
+                    double const step, DoubleDouble const y1, int const linew,
+                    int const maxiters) {
+    using V = typename Ops::V;
+    using M = typename Ops::M;
+    DdLineQueue q{.pline    = pline,
+                  .x1       = x1,
+                  .step     = step,
+                  .cy       = y1,
+                  .linew    = linew,
+                  .maxiters = maxiters};
+
+    V const cyh     = Ops::set1(y1.hi);
+    V const cyl     = Ops::set1(y1.lo);
+    V const escape  = Ops::set1(4.0);
+    V const epsilon = Ops::set1(period_epsilon_dd);
+    V const one     = Ops::set1(1.0);
+    V const mx      = Ops::set1(maxiters);
+
+    DdLanes<Ops> s[groups];
+    int pixel[groups][Ops::N];
+    int alive[groups] = {};
+    for (int g = 0; g < groups; ++g) {
+        for (int l = 0; l < Ops::N; ++l) pixel[g][l] = -1;
+        s[g] = dd_refill<Ops>(DdLanes<Ops>{}, (1 << Ops::N) - 1, pixel[g], alive[g], q);
+    }
+
+    for (unsigned t = 1; q.live > 0; ++t) {
+        for (int g = 0; g < groups; ++g) {
+            if (groups > 1 && alive[g] == 0) continue;
+            DdLanes<Ops>& l = s[g];
+            V x2h = Ops::mul(l.xh, l.xh);
+            V y2h = Ops::mul(l.yh, l.yh);
+            M const done = Ops::either(Ops::gt(Ops::add(x2h, y2h), escape), Ops::eq(l.n, mx));
+            if (int const lanes = Ops::bits(done)) {
+                l   = dd_refill<Ops>(l, lanes, pixel[g], alive[g], q);
+                x2h = Ops::mul(l.xh, l.xh);
+                y2h = Ops::mul(l.yh, l.yh);
+            }
+
+            // x^2, y^2 and x y in double-double; the lo * lo terms are
+            // below the rounding error
+            V const x2l = Ops::add(Ops::prod_error(l.xh, l.xh, x2h),
+                                   Ops::mul(Ops::add(l.xh, l.xh), l.xl));
+            V const y2l = Ops::add(Ops::prod_error(l.yh, l.yh, y2h),
+                                   Ops::mul(Ops::add(l.yh, l.yh), l.yl));
+            V const xyh = Ops::mul(l.xh, l.yh);
+            V const xyl = Ops::add(Ops::prod_error(l.xh, l.yh, xyh),
+                                   Ops::add(Ops::mul(l.xh, l.yl), Ops::mul(l.xl, l.yh)));
+
+            // y = 2 x y + cy, x = x^2 - y^2 + cx
+            dd_add<Ops>(Ops::add(xyh, xyh), Ops::add(xyl, xyl), cyh, cyl, l.yh, l.yl);
+            V dh, dl;
+            dd_sub<Ops>(x2h, x2l, y2h, y2l, dh, dl);
+            dd_add<Ops>(dh, dl, l.cxh, l.cxl, l.xh, l.xl);
+            l.n = Ops::add(l.n, one);
+
+            // Brent's cycle detection every 8th step, as in the double
+            // kernels. Near the saved point the high parts cancel exactly.
+            if (t % 8 == 0) {
+                V const dx = Ops::add(Ops::sub(l.xh, l.xsh), Ops::sub(l.xl, l.xsl));
+                V const dy = Ops::add(Ops::sub(l.yh, l.ysh), Ops::sub(l.yl, l.ysl));
+                M const periodic = Ops::both(Ops::lt(Ops::abs(dx), epsilon),
+                                             Ops::lt(Ops::abs(dy), epsilon));
+                l.n = Ops::select(periodic, mx, l.n);
+
+                M const save = Ops::gt(l.n, l.save_at);
+                l.xsh     = Ops::select(save, l.xh, l.xsh);
+                l.xsl     = Ops::select(save, l.xl, l.xsl);
+                l.ysh     = Ops::select(save, l.yh, l.ysh);
+                l.ysl     = Ops::select(save, l.yl, l.ysl);
+                l.save_at = Ops::select(save, Ops::add(l.save_at, l.save_at), l.save_at);
+            }
+        }
+    }
+}
+
+}  // namespace
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <buffer_pool.hpp>
+#include <render_job.hpp>
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+using vec2i = Eigen::Vector2i;
+
+/// Offset of to's top-left corner from from's, in pixels at to's scale.
+/// Exact at deep zooms when both viewports carry a precise corner.
+vec2 corner_offset(Viewport const& from, Viewport const& to);
+
+/// Whole-pixel translation taking `from` onto `to`, if the viewports only
+/// differ by one and it leaves part of the old frame on screen
+std::optional<vec2i> pixel_shift(Viewport const& from, Viewport const& to,
+                                 int w, int h);
+
+/// Rebuild a w x h frame after the viewport moved by `shift` pixels: pixels
+/// still on screen are copied from `prev`, the exposed strips come from
+/// render(x, y, rw, rh), which returns a row-major rw x rh buffer. The frame
+/// is taken from `buffers` and the strips are given back to it.
+template<class T, class F>
+FrameBuffer<T> shift_frame(FrameBuffer<T> const& prev, BufferPool<T>& buffers,
+                           int w, int h, vec2i const& shift, F&& render) {
+    int const dx = shift.x();
+    int const dy = shift.y();
+    FrameBuffer<T> res = buffers.take(std::size_t(w) * h);
+
+    // Destination area whose source pixels are still on screen
+    int const x1 = std::max(0, -dx), x2 = std::min(w, w - dx);
+    int const y1 = std::max(0, -dy), y2 = std::min(h, h - dy);
+    for (int y = y1; y < y2; ++y) {
+        auto src = prev.begin() + (y + dy) * w + dx;
+        std::copy(src + x1, src + x2, res.begin() + y * w + x1);
+    }
+
+    auto paste = [&](int x, int y, int rw, int rh) {
+        if (rw <= 0 || rh <= 0) return;
+        FrameBuffer<T> part = render(x, y, rw, rh);
+        for (int j = 0; j < rh; ++j) {
+            std::copy_n(part.begin() + j * rw, rw, res.begin() + (y + j) * w + x);
+        }
+        buffers.give(std::move(part));
+    };
+    paste(0, 0, w, y1);
+    paste(0, y2, w, h - y2);
+    paste(0, y1, x1, y2 - y1);
+    paste(x2, y1, w - x2, y2 - y1);
+
+    return res;
+}
+
+/// A w x h frame rebuilt from `prev` after a pan when `shift` is set, else
+/// rendered from scratch in ctl.bands bands. Reports progress to ctl and
+/// throws render_cancelled between calls to render(x, y, rw, rh). Buffers
+/// come from and go back to `buffers` as in shift_frame.
+template<class T, class F>
+FrameBuffer<T> render_frame(FrameBuffer<T> const& prev, BufferPool<T>& buffers,
+                            int w, int h,
+                            std::optional<vec2i> const& shift,
+                            RenderControl<T> const& ctl, F&& render) {
+    auto checked = [&](int x, int y, int rw, int rh) {
+        ctl.check();
+        return render(x, y, rw, rh);
+    };
+    auto report = [&](FrameBuffer<T> const& res, int y1, int y2) {
+        if (ctl.rows_done)
+            ctl.rows_done(std::span(res).subspan(y1 * w, (y2 - y1) * w), y1, y2);
+    };
+
+    if (shift) {
+        auto res = shift_frame(prev, buffers, w, h, *shift, checked);
+        report(res, 0, h);
+        return res;
+    }
+
+    int const bands  = std::max(ctl.bands, 1);
+    int const band_h = (h + bands - 1) / bands;
+    if (band_h >= h) {
+        auto res = checked(0, 0, w, h);
+        report(res, 0, h);
+        return res;
+    }
+
+    FrameBuffer<T> res = buffers.take(std::size_t(w) * h);
+    for (int y = 0; y < h; y += band_h) {
+        int const rh = std::min(band_h, h - y);
+        auto part    = checked(0, y, w, rh);
+        std::copy(part.begin(), part.end(), res.begin() + y * w);
+        buffers.give(std::move(part));
+        report(res, y, y + rh);
+    }
+    return res;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Presenting rendered frames in the viewer's drawing areas
+
+#include <async_render.hpp>
+#include <render_job.hpp>
+#include <gtkmm-4.0/gtkmm.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Cairo image showing the latest frame. Its pixels live in `storage`, which
+/// only grows, so a resize only wraps a new surface around it. Frames are
+/// already in the surface's pixel layout, so drawing converts nothing.
+struct FrameSurface {
+    std::vector<argb32> storage;
+    Cairo::RefPtr<Cairo::ImageSurface> surface;
+};
+
+/// Copy the rows of `frame` that changed into `fs` and mark only those dirty,
+/// rewrapping the surface when the size differs
+void update_surface(FrameSurface& fs, RenderedFrame const& frame);
+
+/// Time per phase and pool utilization of the frame started at
+/// `started_ns` and rendered in `render_ms`, for the stats overlay. Empty
+/// when built without tracing.
+std::string frame_stats_text(std::int64_t started_ns, double render_ms);
+
+/// Paint `fs`, rendered for viewport `shown`, moved and scaled to where it
+/// lies in `current` so panning and zooming respond before the next frame
+void paint_frame(Cairo::RefPtr<Cairo::Context> const& cr,
+                 FrameSurface const& fs, Viewport const& shown,
+                 Viewport const& current);
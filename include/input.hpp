@@ -1,6 +1,7 @@
 #pragma once
 
 #include <config.hpp>
+#include <render_job.hpp>
 #include <gtkmm-4.0/gtkmm.h>
 
 class InputCapture {
@@ -12,9 +13,15 @@ public:
 
 private:
     vec2 top_left;
+    PrecisePoint precise_top_left;  // top_left for deep zooms
     vec2 size;
     double scale;
     double const step = 0.1;
+    /// Zoom levels are 2^(1/levels_per_octave) apart so returning to one gives
+    /// the same scale, and cached tiles line up again
+    static constexpr int levels_per_octave = 64;
+    double const base_scale = 500 / 4;
+    double zoom             = 0;  // in levels, the fraction is accumulated
 
     Glib::RefPtr<Gtk::EventControllerMotion> mouse_input;
     Glib::RefPtr<Gtk::GestureDrag> drag_input;
@@ -43,6 +50,9 @@ public:
     vec2 get_top_left() const { return screen_to_world({0, 0}); }
     vec2 get_bottom_right() const { return screen_to_world(size); }
     vec2 get_mouse_pos() const noexcept { return mouse_pos; }
+    Viewport get_viewport() const {
+        return {.top_left = top_left, .scale = scale, .precise_top_left = precise_top_left};
+    }
     bool mouse_is_inside() const { return mouse_inside; }
     bool is_inside(vec2 const& screenpos) {
         return 0 <= screenpos.x() && screenpos.x() < size.x()
@@ -64,4 +74,3 @@ public:
 };
 
 void draw_coordinate_axes(Cairo::RefPtr<Cairo::Context> const& cr, InputCapture const& mvement, RGB color = {255, 255, 255});
-
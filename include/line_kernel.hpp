@@ -0,0 +1,144 @@
+#pragma once
+
+// Building blocks of the escape-time line kernels. Every kernels_*.cpp
+// includes this with its own instruction set flags, so all of it has
+// internal linkage: the linker must never hand an AVX-512 copy of a helper
+// to the SSE2 kernels. For the same reason the kernels stay clear of
+// out-of-line standard library templates.
+
+#include <simd_kernels.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+/// Orbits that come back this close to an earlier point have settled on an
+/// attracting cycle and never escape
+constexpr double period_epsilon = 1e-13;
+/// The same for float kernels, a few ulps of the orbit's magnitude
+constexpr float period_epsilon_float = 1e-6f;
+
+/// Main cardioid and period-2 bulb, where every point is in the set. With a
+/// margin only points clearly inside count, for coordinates rounded to
+/// doubles from something more precise.
+inline bool in_main_bulbs(double cx, double cy, double margin = 0) {
+    double const xq = cx - 0.25;
+    double const y2 = cy * cy;
+    double const q  = xq * xq + y2;
+    if (q * (q + xq) <= 0.25 * y2 - margin) return true;
+    double const xp = cx + 1;
+    return xp * xp + y2 <= 1.0 / 16 - margin;
+}
+
+/// Pixels of a line handed out one by one to the lanes of the refilling
+/// kernels
+struct LineQueue {
+    int* pline;
+    double x1, step, cy;
+    int linew, maxiters;
+    /// Set for kernels that compute channels
+    LineChannels const* ch = nullptr;
+    int next = 0;
+    int live = 0;  // lanes holding a pixel
+
+    /// Next pixel that needs iterating, or -1. Pixels in the main bulbs are
+    /// written on the way, unless their orbits are needed for the trap.
+    int pop(double& cx) {
+        bool const skip_bulbs = !ch || !ch->trap;
+        for (; next < linew; ++next) {
+            cx = x1 + step * next;
+            if (!skip_bulbs || !in_main_bulbs(cx, cy)) return next++;
+            pline[next] = maxiters;
+            if (ch && ch->smooth) ch->smooth[next] = maxiters;
+        }
+        return -1;
+    }
+};
+
+/// Continuous escape time of an orbit that escaped at z = (x, y) after n
+/// iterations. A few more iterations push |z| far enough out for the
+/// log-log formula to stay continuous at the bailout of 2.
+inline double smooth_escape_time(int n, double x, double y, double cx, double cy) {
+    for (int k = 0; k < 8 && x * x + y * y < 1 << 16; ++k, ++n) {
+        double const t = x * x - y * y + cx;
+        y              = 2 * x * y + cy;
+        x              = t;
+    }
+    double const log2_abs = std::log2(x * x + y * y) / 2;
+    return n + 1 - std::log2(log2_abs);
+}
+
+/// Write out the finished `lanes` of a group and load the next pixels into
+/// them. L holds vectors x, y, cx, xs, ys of lane type L::F and n, save_at
+/// of L::I: n counts iterations and jumps to maxiters once the lane is found
+/// periodic. Lanes without a pixel hold NaNs, which never compare as escaped
+/// or periodic, and the lowest n, so they never finish. Lanes of kernels
+/// computing channels also carry the squared trap distance `trap`. Taken
+/// and returned by value so the hot loop keeps its state in registers.
+template<class L>
+[[gnu::noinline]] L refill(L s, int lanes, int* pixel, int& alive, LineQueue& q) {
+    using F         = typename L::F;
+    using I         = typename L::I;
+    constexpr int N = sizeof(s.x) / sizeof(F);
+    static_assert(sizeof(s.n) == N * sizeof(I));
+    // Constant-evaluated, so no out-of-line copies of the std functions
+    constexpr F nan    = std::numeric_limits<F>::quiet_NaN();
+    constexpr F inf    = std::numeric_limits<F>::infinity();
+    constexpr I lowest = std::numeric_limits<I>::lowest();
+    constexpr bool channels = requires { s.trap; };
+
+    alignas(sizeof(s.x)) F x[N], y[N], cx[N], xs[N], ys[N];
+    alignas(sizeof(s.x)) I n[N], save_at[N];
+    std::memcpy(x, &s.x, sizeof x);
+    std::memcpy(y, &s.y, sizeof y);
+    std::memcpy(cx, &s.cx, sizeof cx);
+    std::memcpy(xs, &s.xs, sizeof xs);
+    std::memcpy(ys, &s.ys, sizeof ys);
+    std::memcpy(n, &s.n, sizeof n);
+    std::memcpy(save_at, &s.save_at, sizeof save_at);
+    F trap[N] = {};
+    if constexpr (channels) std::memcpy(trap, &s.trap, sizeof trap);
+    for (int l = 0; l < N; ++l) {
+        if (!(lanes >> l & 1)) continue;
+        if (int const p = pixel[l]; p >= 0) {
+            int const iters = static_cast<int>(n[l]);
+            q.pline[p]      = iters;
+            if constexpr (channels) {
+                if (q.ch->smooth) {
+                    q.ch->smooth[p] =
+                        iters < q.maxiters
+                            ? smooth_escape_time(iters, x[l], y[l], cx[l], q.cy)
+                            : q.maxiters;
+                }
+                if (q.ch->trap) q.ch->trap[p] = std::sqrt(static_cast<double>(trap[l]));
+            }
+            --alive;
+            --q.live;
+        }
+        double c        = 0;
+        pixel[l]        = q.pop(c);
+        bool const used = pixel[l] >= 0;
+        alive  += used;
+        q.live += used;
+        F const start = used ? 0 : nan;
+        x[l] = y[l] = xs[l] = ys[l] = start;
+        cx[l]      = static_cast<F>(c);
+        n[l]       = used ? 0 : lowest;
+        save_at[l] = 1;
+        trap[l]    = inf;
+    }
+    std::memcpy(&s.x, x, sizeof x);
+    std::memcpy(&s.y, y, sizeof y);
+    std::memcpy(&s.cx, cx, sizeof cx);
+    std::memcpy(&s.xs, xs, sizeof xs);
+    std::memcpy(&s.ys, ys, sizeof ys);
+    std::memcpy(&s.n, n, sizeof n);
+    std::memcpy(&s.save_at, save_at, sizeof save_at);
+    if constexpr (channels) std::memcpy(&s.trap, trap, sizeof trap);
+    return s;
+}
+
+}  // namespace
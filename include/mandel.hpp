@@ -1,6 +1,9 @@
 #pragma once
 
+#include <async_render.hpp>
+#include <frame_view.hpp>
 #include <input.hpp>
+#include <mandel_engine.hpp>
 #include <threadpool.hpp>
 #include <config.hpp>
 #include <fractal.hpp>
@@ -20,40 +23,40 @@ class Mandelbrot: public FractalBase {
     Gtk::Box options;
     Gtk::SpinButton max_iters;
     Gtk::ComboBoxText algorithm_select;
+    /// Entries in KernelPrecision order
+    Gtk::ComboBoxText precision_select;
     Gtk::CheckButton show_path;
+    /// Per-phase times and utilization over the frame, when tracing
+    Gtk::CheckButton show_stats;
+    Gtk::CheckButton subdivide;
     Pango::FontDescription font;
 
-    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    FrameSurface frame_surface;
+    /// Viewport the surface was rendered for, the current one may have moved on
+    Viewport shown_viewport;
+    /// Set once the shown frame is complete
+    std::optional<double> render_time;
+    std::int64_t frame_started_ns = 0;
+    /// Why the last requested frame failed, empty while rendering works
+    std::string render_error;
 
-    ThreadPool tpool;
+    Glib::Dispatcher frame_ready;
+    AsyncRenderer<MandelbrotEngine, MandelJob> renderer;
 
-    void on_resize(int w, int h) {
-        pixbuf = Gdk::Pixbuf::create(Gdk::Colorspace::RGB, false, 8, w, h);
-    }
+    void on_resize(int, int) { request_render(); }
 
-    std::vector<int> calculate_iters(int w, int h);
+    /// Snapshot of the widget state, taken on the GUI thread
+    MandelJob make_job(int w, int h) const;
 
-    Glib::RefPtr<Gdk::Pixbuf> default_alg(int w, int h);
-    Glib::RefPtr<Gdk::Pixbuf> default_alg_optimized(int const w, int const h);
-    Glib::RefPtr<Gdk::Pixbuf> avx2_alg(int w, int h);
-    Glib::RefPtr<Gdk::Pixbuf> avx512_alg(int w, int h);
-    Glib::RefPtr<Gdk::Pixbuf> histogram_alg(int w, int h);
-    Glib::RefPtr<Gdk::Pixbuf> black_and_white(int w, int h);
-
-    void render_pixbuf(Cairo::RefPtr<Cairo::Context> const& cr, int w, int h,
-                       Glib::RefPtr<Gdk::Pixbuf> const& pb) {
-        Gdk::Cairo::set_source_pixbuf(cr, pb);
-        cr->rectangle(0, 0, w, h);
-        cr->fill();
-    }
+    /// Hand the current state to the renderer, cancelling the frame in flight
+    void request_render();
+    /// Pull the rows the renderer published since the last call
+    void on_frame_ready();
 
     void on_draw(Cairo::RefPtr<Cairo::Context> const& cr, int w, int h);
 
     std::vector<vec2> generate_path(vec2 const& screenpos);
 
-    using simd_func = void(int*, double, double, double, int, int);
-    std::vector<int> simd_escape_times(int w, int h, simd_func* alg);
-
 public:
     Mandelbrot();
 
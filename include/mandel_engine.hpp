@@ -0,0 +1,213 @@
+#pragma once
+
+#include <buffer_pool.hpp>
+#include <frame_reuse.hpp>
+#include <palette.hpp>
+#include <partition.hpp>
+#include <perturbation.hpp>
+#include <render_job.hpp>
+#include <simd_kernels.hpp>
+#include <tile_cache.hpp>
+#include <threadpool.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/// Escape times and the extra channels computed in the same pass, one
+/// array per channel. Channels that were not asked for stay empty.
+struct EscapeChannels {
+    FrameBuffer<int> iters;
+    std::vector<float> smooth;  // continuous escape time
+    std::vector<float> trap;    // closest approach of the orbit to the trap
+};
+
+/// Channels MandelbrotEngine::escape_channels computes besides the escape
+/// times
+struct ChannelRequest {
+    bool smooth = false;
+    std::optional<OrbitTrap> trap = std::nullopt;
+};
+
+/// Escape-time computation and colouring for the Mandelbrot set, free of
+/// any GTK state. All parameters come from the job.
+class MandelbrotEngine {
+    ThreadPool& tpool;
+    PerturbationEngine deep_zoom;
+    TileCache cache;
+
+    // Last frame, reused when the next job only pans the viewport
+    std::optional<MandelJob> last_job;
+    FrameBuffer<int> last_iters;
+
+    // Escape-time buffers recycled from frame to frame. Only used from the
+    // thread calling the engine.
+    BufferPool<int> buffers;
+
+    PaletteLut palette;
+    /// Colour of each escape time for the last max_iters coloured, unless
+    /// max_iters is beyond iteration_table_limit
+    std::vector<argb32> iter_colors;
+    static constexpr int iteration_table_limit = 1 << 20;
+    /// Per-worker histograms of with_histogram_colors; the first holds the
+    /// colour of each escape time once it is done
+    std::vector<std::vector<std::uint32_t>> histograms;
+    /// Distinct escape times and their colours, when with_histogram_colors
+    /// sorted rather than counted
+    std::vector<int> histogram_values;
+    std::vector<argb32> histogram_colors;
+
+    /// f(y1, y2) over chunks of rows of about equal total row_costs on the
+    /// thread pool, heaviest first. f fills those rows of `out`, whose
+    /// iterations the trace records per chunk.
+    template<class F>
+    void run_chunks(std::span<double const> row_costs, std::span<int const> out,
+                    F const& f);
+
+    /// The job with its precision resolved from AUTO, and its algorithm
+    /// DEEP_ZOOM where double-double, automatic or forced, runs out
+    static MandelJob resolved(MandelJob job);
+    std::optional<vec2i> reusable_shift(MandelJob const& job) const;
+    FrameBuffer<int> compute_escape_times(MandelJob const& job);
+    /// Assemble the job from cached tiles, computing and storing the
+    /// missing ones. Falls back to compute_escape_times when the viewport is
+    /// off the tile grid.
+    FrameBuffer<int> cached_escape_times(MandelJob const& job);
+
+    FrameBuffer<int> calculate_iters(MandelJob const& job);
+    FrameBuffer<int> optimized_escape_times(MandelJob const& job);
+
+    /// Write color_of(i) for every pixel i of the job, row-major, into
+    /// `data`, rows in parallel
+    template<class F>
+    void paint(MandelJob const& job, std::uint8_t* data, int rowstride,
+               PixelFormat format, F const& color_of);
+
+    void colorize_hue(MandelJob const& job, std::span<int const> iters,
+                      std::uint8_t* data, int rowstride, PixelFormat format);
+    /// f(color_of) with color_of(n) the histogram colour of escape time n
+    /// in the frame of `iters`, valid only during the call
+    template<class F>
+    decltype(auto) with_histogram_colors(MandelJob const& job,
+                                         std::span<int const> iters, F const& f);
+    void colorize_histogram(MandelJob const& job, std::span<int const> iters,
+                            std::uint8_t* data, int rowstride, PixelFormat format);
+    void colorize_black_and_white(MandelJob const& job,
+                                  std::span<int const> iters, std::uint8_t* data,
+                                  int rowstride, PixelFormat format);
+
+    /// The work of antialias, with color_of(n) the colour of escape time n
+    template<class F>
+    int resample_edges(MandelJob const& job, std::uint8_t* data, int rowstride,
+                       PixelFormat format, F const& color_of);
+
+    /// Instruction set job.algorithm runs with on this CPU: AVX2 caps it at
+    /// AVX2, the other SIMD algorithms take the best available
+    static SimdLevel simd_level(MandelJob const& job);
+
+    /// A line kernel with lines addressed in pixels from the viewport's top
+    /// left, so that the double-double kernel keeps the corner's low digits
+    struct LineSampler {
+        line_kernel* kernel = nullptr;  // unless dd_kernel is set
+        dd_line_kernel* dd_kernel = nullptr;
+        vec2 top_left = {0, 0};
+        DoubleDouble left = {}, top = {};
+        double step = 0;
+
+        /// n points `spacing` apart from pixel (x, y) rightwards. Channels
+        /// are not computed in double-double.
+        void operator()(int* out, double x, double y, double spacing, int n, int mx,
+                        LineChannels const& ch = {}) const;
+    };
+    /// Kernel of the job's resolved precision at simd_level(job)
+    static LineSampler line_sampler(MandelJob const& job);
+
+    /// Lines in parallel through `alg`; `ch` points at whole-image channels
+    FrameBuffer<int> simd_escape_times(MandelJob const& job, LineSampler const& alg,
+                                       LineChannels const& ch = {});
+    /// Mariani-Silver: only computes the border of each box, fills it when
+    /// the border is uniform and splits it otherwise
+    FrameBuffer<int> subdivided_escape_times(MandelJob const& job,
+                                             LineSampler const& alg);
+
+public:
+    explicit MandelbrotEngine(ThreadPool& pool): tpool(pool), deep_zoom(pool) {}
+
+    /// Escape time of every pixel, row-major, using job.algorithm's kernel.
+    /// When the viewport moved by whole pixels since the last call only the
+    /// newly exposed strips are computed.
+    FrameBuffer<int> escape_times(MandelJob const& job,
+                                  RenderControl<int> const& ctl = {});
+
+    /// Arithmetic job.algorithm's kernel runs in: as forced by
+    /// job.precision, or under AUTO the narrowest of float, double and
+    /// double-double that resolves the pixel spacing at the viewport's
+    /// coordinates. Double-double lasts to a spacing of 2^-100 of those
+    /// coordinates, about 1.6e-30 near the origin; deeper views under AUTO
+    /// or DOUBLE_DOUBLE are rendered by DEEP_ZOOM instead. DOUBLE for the
+    /// non-SIMD algorithms.
+    static KernelPrecision kernel_precision(MandelJob const& job);
+    static bool single_precision(MandelJob const& job) {
+        return kernel_precision(job) == KernelPrecision::SINGLE;
+    }
+
+    /// Escape times and the requested channels in one pass of the SIMD
+    /// kernels, without frame reuse, tile cache or subdivision. Throws
+    /// std::invalid_argument for the other algorithms, and for views that
+    /// need double-double.
+    EscapeChannels escape_channels(MandelJob const& job, ChannelRequest const& req);
+
+    /// Kernel escape_times(job) runs on this CPU, e.g. "AVX-512 float"
+    static std::string kernel_name(MandelJob const& job);
+
+    /// Hand back a buffer escape_times returned, to be reused by later frames
+    void recycle(FrameBuffer<int>&& iters) { buffers.give(std::move(iters)); }
+
+    /// Whether escape_times(job) would only compute the strips a pan exposed
+    bool can_reuse(MandelJob const& job) const {
+        return reusable_shift(resolved(job)).has_value();
+    }
+    /// Whether colours depend on the whole frame, so rows coloured on their
+    /// own are only a preview
+    static bool colors_need_whole_frame(MandelJob const& job) {
+        return job.algorithm == MandelAlgorithm::HISTOGRAM;
+    }
+
+    /// Write pixels for the escape times into `data`, 8-bit RGB or argb32
+    /// words such as a Cairo image surface holds
+    void colorize(MandelJob const& job, std::span<int const> iters,
+                  std::uint8_t* data, int rowstride,
+                  PixelFormat format = PixelFormat::RGB);
+
+    /// Colour by trap distance when there is a trap channel, else by the
+    /// smooth escape time, else as above
+    void colorize(MandelJob const& job, EscapeChannels const& ch,
+                  std::uint8_t* data, int rowstride,
+                  PixelFormat format = PixelFormat::RGB);
+
+    /// Anti-alias `data`, the frame colorize(job, iters, ...) wrote. The
+    /// samples are coloured from `iters` alone, so other frames may have been
+    /// coloured in between. Pixels whose colour differs from a neighbour's by
+    /// more than job.antialias_threshold get up to job.antialias^2
+    /// stratified samples, run through the line kernels in batches, and take
+    /// their mean colour. From 3 x 3 on, a quarter of them come first and a
+    /// pixel gets the rest only if those differ from its colour.
+    /// Returns the number of pixels re-sampled: none for deep zooms.
+    int antialias(MandelJob const& job, std::span<int const> iters,
+                  std::uint8_t* data, int rowstride,
+                  PixelFormat format = PixelFormat::RGB);
+
+    /// Compute, colour and anti-alias a frame into `data`
+    void render(MandelJob const& job, std::uint8_t* data, int rowstride,
+                PixelFormat format = PixelFormat::RGB);
+    /// render() for a tile of a larger image. Anti-aliasing renders a
+    /// one-pixel border around the tile too, so edges along its sides are
+    /// found as in the whole image and the tiles join without seams.
+    void render_tile(MandelJob const& job, std::uint8_t* data, int rowstride,
+                     PixelFormat format = PixelFormat::RGB);
+
+    PerturbationEngine const& deep_zoom_engine() const { return deep_zoom; }
+    TileCache& tile_cache() { return cache; }
+};
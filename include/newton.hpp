@@ -1,9 +1,12 @@
 #pragma once
 
+#include "async_render.hpp"
 #include "config.hpp"
 #include "fractal.hpp"
+#include "frame_view.hpp"
 #include "input.hpp"
 #include "math_tools.hpp"
+#include "newton_engine.hpp"
 #include "threadpool.hpp"
 
 #include <cstdint>
@@ -14,9 +17,12 @@ class NewtonFractal: public FractalBase {
     InputCapture movement;
     Gtk::SpinButton max_iters;
     Gtk::CheckButton show_path;
+    /// Per-phase times and utilization over the frame, when tracing
+    Gtk::CheckButton show_stats;
     Gtk::CheckButton draw_axis;
     Pango::FontDescription font;
-    ThreadPool tpool;
+    Glib::Dispatcher frame_ready;
+    AsyncRenderer<NewtonEngine, NewtonJob> renderer;
 
     Gtk::Button input_polynomial;
     Gtk::Dialog polynomial_input_dialog;
@@ -34,26 +40,28 @@ class NewtonFractal: public FractalBase {
 
     math::complex* active_root = nullptr;
 
-    static const std::vector<RGB> root_colors;
+    FrameSurface frame_surface;
+    /// Viewport the surface was rendered for, the current one may have moved on
+    Viewport shown_viewport;
+    /// Set once the shown frame is complete
+    std::optional<double> render_time;
+    std::int64_t frame_started_ns = 0;
+    /// Why the last requested frame failed, empty while rendering works
+    std::string render_error;
 
-    struct point {
-        int iterations;
-        int root;
-    };
-
-    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
-    void on_resize(int w, int h);
+    /// Hand the current state to the renderer, cancelling the frame in flight
+    void request_render();
+    /// Pull the rows the renderer published since the last call
+    void on_frame_ready();
 
     void on_input_polynomial_pressed();
     void on_dialog_ok_pressed();
     void on_dialog_response(int response_id);
 
-    std::vector<point> simple_alg(int w, int h);
-    void render_color(std::vector<point> const& pts);
+    /// Snapshot of the widget state, taken on the GUI thread
+    NewtonJob make_job(int w, int h) const;
     std::vector<vec2> generate_path(math::complex const& z);
 
-    bool is_near(std::complex<double> const& a, std::complex<double> const& b) const;
-
     void on_draw(Cairo::RefPtr<Cairo::Context> const& cr, int w, int h);
 
     void on_mouse_click(InputCapture::MOUSE_CLICK);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <buffer_pool.hpp>
+#include <frame_reuse.hpp>
+#include <palette.hpp>
+#include <partition.hpp>
+#include <render_job.hpp>
+#include <threadpool.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// Newton iteration on the job's polynomial, free of any GTK state
+class NewtonEngine {
+public:
+    struct point {
+        int iterations;
+        int root;
+    };
+
+private:
+    ThreadPool& tpool;
+
+    // Last frame, reused when the next job only pans the viewport
+    std::optional<NewtonJob> last_job;
+    FrameBuffer<point> last_points;
+    // Point buffers recycled from frame to frame
+    BufferPool<point> buffers;
+
+    std::optional<vec2i> reusable_shift(NewtonJob const& job) const;
+    FrameBuffer<point> compute_escape_times(NewtonJob const& job);
+
+public:
+    static const std::vector<RGB> root_colors;
+
+    explicit NewtonEngine(ThreadPool& pool): tpool(pool) {}
+
+    /// Iterations until convergence and the index of the root reached (-1 if
+    /// none) for every pixel, row-major. When the viewport moved by whole
+    /// pixels since the last call only the newly exposed strips are computed.
+    FrameBuffer<point> escape_times(NewtonJob const& job,
+                                    RenderControl<point> const& ctl = {});
+
+    /// Hand back a buffer escape_times returned, to be reused by later frames
+    void recycle(FrameBuffer<point>&& pts) { buffers.give(std::move(pts)); }
+
+    /// Whether escape_times(job) would only compute the strips a pan exposed
+    bool can_reuse(NewtonJob const& job) const {
+        return reusable_shift(job).has_value();
+    }
+    static bool colors_need_whole_frame(NewtonJob const&) { return false; }
+
+    /// Write pixels for the points into `data`, 8-bit RGB or argb32 words
+    void colorize(NewtonJob const& job, std::span<point const> pts,
+                  std::uint8_t* data, int rowstride,
+                  PixelFormat format = PixelFormat::RGB) const;
+
+    /// Compute and colour a frame into `data`
+    void render(NewtonJob const& job, std::uint8_t* data, int rowstride,
+                PixelFormat format = PixelFormat::RGB);
+
+    static bool is_near(math::complex const& a, math::complex const& b);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <config.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/// Colour packed like Cairo's ARGB32: 0xAARRGGBB in a native-endian word
+using argb32 = std::uint32_t;
+
+inline argb32 pack_argb(RGB const& c) {
+    // Truncates like the byte conversion the colorizers always did
+    return 0xff000000u | std::uint32_t(std::uint8_t(c[0])) << 16
+           | std::uint32_t(std::uint8_t(c[1])) << 8 | std::uint8_t(c[2]);
+}
+
+/// Layout of the pixels the colorizers write
+enum class PixelFormat : int {
+    RGB,     // 3 bytes: red, green, blue
+    ARGB32,  // argb32 words, as in Cairo's ARGB32 and RGB24 image surfaces
+};
+
+constexpr int bytes_per_pixel(PixelFormat format) {
+    return format == PixelFormat::RGB ? 3 : 4;
+}
+
+inline void write_rgb(std::uint8_t* px, argb32 c) {
+    px[0] = c >> 16;
+    px[1] = c >> 8;
+    px[2] = c;
+}
+
+/// Write pixel x of a row in `format`
+inline void write_pixel(std::uint8_t* row, int x, argb32 c, PixelFormat format) {
+    if (format == PixelFormat::ARGB32)
+        std::memcpy(row + 4 * x, &c, sizeof c);
+    else
+        write_rgb(row + 3 * x, c);
+}
+
+/// Pixel x of a row in `format`, opaque
+inline argb32 read_pixel(std::uint8_t const* row, int x, PixelFormat format) {
+    if (format == PixelFormat::ARGB32) {
+        argb32 c;
+        std::memcpy(&c, row + 4 * x, sizeof c);
+        return c;
+    }
+    std::uint8_t const* px = row + 3 * x;
+    return 0xff000000u | std::uint32_t(px[0]) << 16 | std::uint32_t(px[1]) << 8 | px[2];
+}
+
+/// The Palette sampled into tables, so colouring a pixel is one lookup
+/// instead of a search and a lerp in doubles
+class PaletteLut {
+public:
+    /// Neighbouring entries of the hue table are closer than one 8-bit step
+    static constexpr int hue_steps = 4096;
+
+    PaletteLut();
+
+    /// Colour of a hue in [0, 1], rounded to the nearest table entry
+    argb32 hue(double h) const {
+        return by_hue[static_cast<int>(h * (hue_steps - 1) + 0.5)];
+    }
+
+    /// Exact colours of the hues n / max_iters, indexed by n in [0, max_iters]
+    static std::vector<argb32> for_iterations(int max_iters);
+
+private:
+    std::vector<argb32> by_hue;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <threadpool.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <span>
+#include <vector>
+
+/// Rows [begin, end) of a frame and their estimated cost
+struct RowChunk {
+    int begin;
+    int end;
+    double cost;
+};
+
+/// Cut rows [0, costs.size()) into at most `count` consecutive chunks of
+/// about equal total cost, ordered heaviest first so that a FIFO pool starts
+/// the longest tasks before the short ones that fill in around them
+std::vector<RowChunk> cost_balanced_chunks(std::span<double const> costs, int count);
+
+/// Chunks a frame is cut into. Well above the thread count, so errors in
+/// the cost estimate even out.
+constexpr int chunks_per_frame = 128;
+
+/// Rows and columns between the probed pixels of probe_row_costs
+constexpr int probe_step = 8;
+
+/// Cost estimate for each of the h rows of a w-wide frame, from a cheap
+/// low-resolution probe: probe(y, line) computes every probe_step-th pixel
+/// of row y into `line` and is timed. Every probe_step-th row is probed, in
+/// parallel on `pool`, and stands for the rows up to the next one. Frames
+/// too small to be worth probing get equal costs.
+template<class T, class F>
+std::vector<double> probe_row_costs(ThreadPool& pool, int w, int h, F const& probe) {
+    std::vector<double> costs(h, 1.0);
+    int const probes = (h + probe_step - 1) / probe_step;
+    int const pw     = (w + probe_step - 1) / probe_step;
+    if (probes < 8 || pw < 8) return costs;
+
+    pool.parallel_for(0, probes, [&](int p1, int p2) {
+        std::vector<T> line(pw);
+        for (int p = p1; p < p2; ++p) {
+            auto const beg = std::chrono::steady_clock::now();
+            probe(p * probe_step, std::span(line));
+            std::chrono::duration<double> const t = std::chrono::steady_clock::now() - beg;
+            std::fill_n(costs.begin() + p * probe_step,
+                        std::min(probe_step, h - p * probe_step), t.count());
+        }
+    });
+    return costs;
+}
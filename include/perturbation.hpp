@@ -0,0 +1,64 @@
+#pragma once
+
+#include <buffer_pool.hpp>
+#include <render_job.hpp>
+#include <threadpool.hpp>
+
+#include <vector>
+
+/// Deep-zoom Mandelbrot renderer. One reference orbit is iterated in
+/// arbitrary precision and every pixel only tracks its double-precision
+/// offset from it:
+///     dz' = 2 Z dz + dz^2 + dc
+/// A cubic series in dc skips the iterations where all pixels still move
+/// together, and pixels whose offset loses precision (|Z + dz| << |Z|) are
+/// re-rendered against a new reference picked among them. Works until the
+/// pixel size underflows a double (around 1e-300).
+class PerturbationEngine {
+public:
+    struct OrbitPoint {
+        double re;
+        double im;
+        double glitch_r2;  // |Z|^2 scaled by the glitch tolerance
+    };
+
+    /// Reference orbit Z_0 .. Z_n, ending at the first escaped point or
+    /// after max_iters iterations
+    static std::vector<OrbitPoint> reference_orbit(PrecisePoint const& c,
+                                                   int max_iters);
+
+    struct Stats {
+        int references      = 0;
+        int skipped_iters   = 0;  // by the series approximation, first reference
+        int glitched_pixels = 0;  // left after the last re-reference
+    };
+
+    explicit PerturbationEngine(ThreadPool& pool): tpool(pool) {}
+
+    /// Escape time of every pixel, row-major
+    FrameBuffer<int> escape_times(MandelJob const& job);
+
+    Stats const& last_stats() const noexcept { return stats; }
+
+    constexpr static int max_references = 64;
+
+private:
+    ThreadPool& tpool;
+    Stats stats;
+
+    struct Series {
+        int skip = 0;
+        math::complex a, b, c;
+    };
+    static Series series_approximation(std::vector<OrbitPoint> const& orbit,
+                                       std::vector<math::complex> const& probes,
+                                       int max_iters);
+
+    struct Glitch {
+        int index;
+        double ratio;  // |z|^2 / |Z|^2 where the glitch was detected
+    };
+    void render_pixels(MandelJob const& job, vec2 const& ref_pixel,
+                       std::vector<int> const& pixels, FrameBuffer<int>& out,
+                       std::vector<Glitch>& glitches);
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <config.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <gmpxx.h>
+
+/// Bits needed to address individual pixels at `scale` pixels per unit,
+/// with headroom for coordinates up to a few units from the origin
+inline unsigned precision_for_scale(double scale) {
+    int const exp = scale > 1 ? std::ilogb(scale) : 0;
+    return std::max(64, exp + 64);
+}
+
+/// Arbitrary-precision point in the complex plane, used for viewport
+/// origins and reference orbits once doubles can no longer tell pixels apart
+struct PrecisePoint {
+    mpf_class x;
+    mpf_class y;
+
+    PrecisePoint(): PrecisePoint(vec2{0, 0}, 64) {}
+    PrecisePoint(vec2 const& v, unsigned bits)
+        : x(v.x(), bits), y(v.y(), bits) {}
+    PrecisePoint(mpf_class const& x_, mpf_class const& y_): x(x_), y(y_) {}
+
+    /// Raise the precision, keeping the current value
+    void set_precision(unsigned bits) {
+        if (x.get_prec() < bits) x.set_prec(bits);
+        if (y.get_prec() < bits) y.set_prec(bits);
+    }
+
+    PrecisePoint& operator+=(vec2 const& d) {
+        x += d.x();
+        y += d.y();
+        return *this;
+    }
+    PrecisePoint& operator-=(vec2 const& d) {
+        x -= d.x();
+        y -= d.y();
+        return *this;
+    }
+    friend PrecisePoint operator+(PrecisePoint p, vec2 const& d) {
+        return p += d;
+    }
+
+    /// Round to the nearest point of the pixel grid at `scale`
+    void snap_to_grid(double scale) {
+        x = floor(x * scale + 0.5) / scale;
+        y = floor(y * scale + 0.5) / scale;
+    }
+
+    vec2 to_vec2() const { return {x.get_d(), y.get_d()}; }
+};
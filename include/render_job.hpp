@@ -0,0 +1,119 @@
+#pragma once
+
+#include <config.hpp>
+#include <math_tools.hpp>
+#include <precise.hpp>
+
+#include <exception>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+/// Mapping between pixels and the complex plane, snapshotted from
+/// InputCapture so render jobs never touch widgets.
+struct Viewport {
+    vec2 top_left = {-2, -2};
+    double scale  = 500 / 4;  // pixels per world unit
+    /// Exact top_left for deep zooms, where the double has lost the
+    /// low-order digits. Unset means top_left is exact.
+    std::optional<PrecisePoint> precise_top_left = std::nullopt;
+
+    vec2 world_to_screen(vec2 const& world) const noexcept {
+        return (world - top_left) * scale;
+    }
+    vec2 screen_to_world(vec2 const& screen) const noexcept {
+        return screen / scale + top_left;
+    }
+    double pixel_size() const noexcept { return 1 / scale; }
+
+    PrecisePoint precise_screen_to_world(vec2 const& screen) const {
+        unsigned const bits = precision_for_scale(scale);
+        PrecisePoint p      = precise_top_left.value_or(PrecisePoint(top_left, bits));
+        p.set_precision(bits);
+        return p += screen / scale;
+    }
+
+    /// Same mapping with its origin moved to `screen`
+    Viewport shifted(vec2 const& screen) const {
+        Viewport v = *this;
+        v.top_left = screen_to_world(screen);
+        if (precise_top_left) v.precise_top_left = precise_screen_to_world(screen);
+        return v;
+    }
+};
+
+/// Same order as the entries of Mandelbrot's algorithm combo box
+enum class MandelAlgorithm : int {
+    DEFAULT,
+    HISTOGRAM,
+    OPTIMIZED,
+    AVX2,
+    AVX512,
+    BLACK_AND_WHITE,
+    DEEP_ZOOM,
+};
+
+/// Point, or line through `point` along `direction`, whose distance to
+/// each orbit the orbit-trap channel records
+struct OrbitTrap {
+    vec2 point = {0, 0};
+    std::optional<vec2> direction = std::nullopt;
+};
+
+/// Arithmetic of the SIMD kernels. AUTO uses float while it can still tell
+/// neighbouring pixels apart, then double, then double-double, and hands
+/// views deeper still to perturbation.
+enum class KernelPrecision : int {
+    AUTO,
+    DOUBLE,
+    SINGLE,
+    DOUBLE_DOUBLE,
+};
+
+struct MandelJob {
+    Viewport viewport;
+    int width;
+    int height;
+    int max_iters;
+    MandelAlgorithm algorithm = MandelAlgorithm::AVX2;
+    /// Skip areas enclosed by a uniform border, SIMD algorithms only
+    bool subdivide = false;
+    KernelPrecision precision = KernelPrecision::AUTO;
+    /// Samples per side that MandelbrotEngine::antialias takes in pixels
+    /// on an edge; below 2 for none
+    int antialias = 1;
+    /// Least colour difference from a neighbour, summed over the channels,
+    /// that puts a pixel on an edge
+    int antialias_threshold = 48;
+};
+
+struct NewtonJob {
+    Viewport viewport;
+    int width;
+    int height;
+    int max_iters;
+    math::Polynomial polynomial;
+    math::Polynomial derivative;
+    std::vector<math::complex> roots;
+};
+
+/// Thrown by an engine when its RenderControl's stop token fires
+struct render_cancelled: std::exception {
+    char const* what() const noexcept override { return "render cancelled"; }
+};
+
+/// Lets a caller on another thread follow and abort a render. The frame is
+/// computed in `bands` horizontal bands; after each one `rows_done` receives
+/// the finished rows [y1, y2) and the stop token is checked.
+template<class T>
+struct RenderControl {
+    std::stop_token stop = {};
+    std::function<void(std::span<T const> rows, int y1, int y2)> rows_done = {};
+    int bands = 1;
+
+    void check() const {
+        if (stop.stop_requested()) throw render_cancelled();
+    }
+};
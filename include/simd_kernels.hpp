@@ -0,0 +1,64 @@
+#pragma once
+
+/// Instruction sets the escape-time line kernels are built for, in
+/// increasing order
+enum class SimdLevel : int {
+    SSE2,
+    AVX2,    // with FMA
+    AVX512,  // F and DQ
+};
+
+/// Orbit trap as the quadratic form
+///   distance^2 = (a x + b y + c)^2 + (d x + e y + f)^2
+/// The point (px, py) is {1, 0, -px, 0, 1, -py}; the line a x + b y + c = 0
+/// with a^2 + b^2 = 1 is {a, b, c, 0, 0, 0}.
+struct TrapForm {
+    double a, b, c, d, e, f;
+};
+
+/// Optional per-pixel outputs of a line kernel, filled in the same pass as
+/// the escape times. Each is null or linew long.
+struct LineChannels {
+    float* smooth = nullptr;  // continuous escape time, maxiters inside
+    float* trap   = nullptr;  // closest approach of the orbit to trap_form
+    TrapForm trap_form = {};
+};
+
+/// Writes the escape times of the linew pixels from x1 up to x2 on the
+/// line at y1 into pline, and the channels `ch` asks for
+using line_kernel = void(int* pline, double x1, double x2, double y1,
+                         int linew, int maxiters, LineChannels const& ch);
+
+/// hi + lo with |lo| at most half an ulp of hi: about 106 bits of mantissa,
+/// for zooms too deep for double
+struct DoubleDouble {
+    double hi = 0;
+    double lo = 0;
+};
+
+/// Exact to within the rounding of the result
+DoubleDouble operator+(DoubleDouble a, double b);
+
+/// Writes the escape times of the linew pixels at x1 + i * step on the line
+/// at y1 into pline, iterating in double-double. Computes no channels.
+using dd_line_kernel = void(int* pline, DoubleDouble x1, double step,
+                            DoubleDouble y1, int linew, int maxiters);
+
+/// Best level the CPU and OS support, read from CPUID once
+SimdLevel detected_simd_level();
+char const* simd_level_name(SimdLevel level);
+
+/// The double or float kernel for `level`. Throws std::invalid_argument
+/// when the CPU does not support it.
+line_kernel* line_kernel_for(SimdLevel level, bool single);
+
+/// The double-double kernel for `level`. Throws std::invalid_argument when
+/// the CPU does not support it.
+dd_line_kernel* dd_line_kernel_for(SimdLevel level);
+
+// One translation unit per instruction set, each compiled with its own
+// flags. Only call a kernel the CPU supports.
+line_kernel sse2_render_line, sse2_render_line_float;
+line_kernel avx2_render_line, avx2_render_line_float;
+line_kernel avx512_render_line, avx512_render_line_float;
+dd_line_kernel sse2_render_line_dd, avx2_render_line_dd, avx512_render_line_dd;
@@ -1,53 +1,489 @@
 #pragma once
 
+#include <topology.hpp>
+#include <trace.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <deque>
-#include <thread>
+#include <exception>
 #include <future>
-#include <condition_variable>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
 #include <vector>
 
+/// How a ThreadPool places its workers
+struct PoolOptions {
+    /// Workers to start, by default one per CPU the process may run on
+    int threads = cpu_topology().cpu_count();
+    /// Pin each worker to a CPU, taking the NUMA nodes in turn, so workers
+    /// keep their caches and the pages they touch first stay on their node
+    bool pin = false;
+};
+
+/// Scheduling classes, most urgent first. Workers always take queued work
+/// of a more urgent class first, and a parallel_for lets it in between its
+/// pieces, so a UI interaction never waits behind a whole background frame.
+enum class TaskPriority {
+    INTERACTIVE,  // the user is waiting on it, e.g. a preview
+    VISIBLE,      // what is on screen
+    BACKGROUND,   // prefetching and batch output
+};
+
+/// Thrown through the future of a queued task whose deadline passed before
+/// a worker could start it
+struct task_expired: std::exception {
+    char const* what() const noexcept override { return "task deadline expired"; }
+};
+
+struct TaskOptions {
+    TaskPriority priority = TaskPriority::VISIBLE;
+    /// Dropped unstarted past this; never by default
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+};
+
+/// Work-stealing pool. Each worker owns a lock-free deque: it pushes and
+/// pops its own tasks at the bottom while idle workers steal from the top.
+/// Tasks submitted from other threads go through a shared injection queue.
+///
+/// parallel_for hands a range out in adaptively sized pieces to the workers
+/// and the calling thread. It allocates nothing and waits on a latch, so
+/// frames can be split finely without per-task costs; queue() remains for
+/// one-off tasks with a future.
+///
+/// Every class has its own deques and injection queue. Work submitted by a
+/// thread takes on that thread's priority, see PriorityScope.
+///
+/// Idle workers steal from workers on their own NUMA node before crossing
+/// to another. The viewer's fractals share one process-wide pool, shared().
 class ThreadPool {
-    struct F_BASE {
-        virtual void call() = 0;
-        virtual ~F_BASE()   = default;
+public:
+    struct Task {
+        virtual void run() = 0;
+        /// Drop a task the pool shuts down without running
+        virtual void discard() {}
+        /// Drop a task whose deadline passed before it started
+        virtual void expire() { discard(); }
+
+        TaskPriority priority = TaskPriority::VISIBLE;
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::time_point::max();
+        [[no_unique_address]] trace::Stamp queued;
+
+    protected:
+        ~Task() = default;
     };
+
+private:
+    /// Chase-Lev deque of non-owning task pointers (Le et al., "Correct and
+    /// Efficient Work-Stealing for Weak Memory Models", 2013)
+    class WorkDeque {
+        static constexpr std::int64_t capacity = 1024;  // a power of two
+        alignas(64) std::atomic<std::int64_t> top{0};
+        alignas(64) std::atomic<std::int64_t> bottom{0};
+        std::array<std::atomic<Task*>, capacity> slots{};
+
+    public:
+        /// Owner only. False when full.
+        bool push(Task* t) {
+            std::int64_t const b = bottom.load(std::memory_order_relaxed);
+            if (b - top.load(std::memory_order_acquire) >= capacity) return false;
+            slots[b & (capacity - 1)].store(t, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /// Owner only. The task pushed last, or null.
+        Task* pop() {
+            std::int64_t const b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Task* task = slots[b & (capacity - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                // Last one, race the thieves for it
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed))
+                    task = nullptr;
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        /// Any thread. The oldest task, or null when empty or lost a race.
+        Task* steal() {
+            std::int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t const b = bottom.load(std::memory_order_acquire);
+            if (t >= b) return nullptr;
+            Task* task = slots[t & (capacity - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                return nullptr;
+            return task;
+        }
+    };
+
+    /// Shared state of one parallel_for, on the caller's stack
+    struct Bulk {
+        ThreadPool* pool;
+        TaskPriority priority;
+        void (*body)(void const* f, int i1, int i2);
+        void const* f;
+        std::atomic<int> next;
+        int end;
+        int grain;
+        int parts;  // threads that may be claiming
+        std::atomic<int> unstarted;  // helpers still queued
+        std::atomic_flag failed;
+        std::exception_ptr error;
+        std::latch helpers_done;
+
+        Bulk(ThreadPool* pool, TaskPriority priority,
+             void (*body)(void const*, int, int), void const* f, int begin,
+             int end, int grain, int parts, int helpers)
+            : pool(pool), priority(priority), body(body), f(f), next(begin),
+              end(end), grain(grain), parts(parts), unstarted(helpers),
+              helpers_done(helpers) {}
+
+        /// Guided self-scheduling: a share of what is left, at least grain
+        bool claim(int& i1, int& i2) {
+            int cur = next.load(std::memory_order_relaxed);
+            while (cur < end) {
+                int const n = std::min(std::max(grain, (end - cur) / (2 * parts)),
+                                       end - cur);
+                if (next.compare_exchange_weak(cur, cur + n, std::memory_order_relaxed)) {
+                    i1 = cur;
+                    i2 = cur + n;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work() {
+            int i1, i2;
+            while (claim(i1, i2)) {
+                try {
+                    trace::Span piece("piece", trace::work);
+                    piece.arg("begin", i1);
+                    piece.arg("end", i2);
+                    body(f, i1, i2);
+                } catch (...) {
+                    if (!failed.test_and_set()) error = std::current_exception();
+                    next.store(end, std::memory_order_relaxed);
+                }
+                pool->run_urgent(priority);
+            }
+        }
+    };
+
+    struct Helper final : Task {
+        Bulk* bulk = nullptr;
+        void run() override {
+            bulk->unstarted.fetch_sub(1);
+            bulk->work();
+            bulk->helpers_done.count_down();
+        }
+    };
+    /// Most helpers one parallel_for pushes; the rest of the pool steals
+    static constexpr int max_helpers = 64;
+
+    // Fixed before any worker starts reading them
+    int const workers;
+    std::vector<int> worker_node;  // all 0 unless pinned
     std::vector<std::thread> threads;
-    std::deque<std::unique_ptr<F_BASE>> tasks_queue;
+    static constexpr int lanes = 3;  // one per TaskPriority
+    std::unique_ptr<std::array<WorkDeque, lanes>[]> deques;
 
-    std::condition_variable update;
-    std::mutex tasks_mtx;
+    std::mutex inject_mtx;
+    std::array<std::deque<Task*>, lanes> injected;
+    std::array<std::atomic<int>, lanes> injected_size{};  // read without the lock
+
+    // Tasks in any queue and in each lane, and workers asleep waiting for one
+    std::atomic<int> pending = 0;
+    std::array<std::atomic<int>, lanes> queued{};
+    std::atomic<int> sleeping = 0;
+    std::mutex sleep_mtx;
+    std::condition_variable wake;
 
     std::atomic_bool stop_flag = false;
 
-    void thread_func() {
+    /// Index of the calling thread among this pool's workers, or -1
+    int worker_index() const {
+        return current_pool == this ? current_worker : -1;
+    }
+    static inline thread_local ThreadPool const* current_pool = nullptr;
+    static inline thread_local int current_worker             = -1;
+    static inline thread_local TaskPriority current_priority  = TaskPriority::VISIBLE;
+
+    /// Queue t in its lane without waking anyone
+    void push(Task* t) {
+        int const self = worker_index();
+        int const lane = int(t->priority);
+        t->queued.set();
+        if (self < 0 || !deques[self][lane].push(t)) inject(t);
+        queued[lane].fetch_add(1);
+    }
+
+    void submit(Task* t) {
+        push(t);
+        pending.fetch_add(1);
+        notify(1);
+    }
+
+    void inject(Task* t) {
+        int const lane = int(t->priority);
+        std::lock_guard g(inject_mtx);
+        injected[lane].push_back(t);
+        injected_size[lane].store(injected[lane].size(), std::memory_order_relaxed);
+    }
+
+    void notify(int n) {
+        if (sleeping.load() == 0) return;
+        std::lock_guard g(sleep_mtx);
+        if (n == 1)
+            wake.notify_one();
+        else
+            wake.notify_all();
+    }
+
+    /// The most urgent task in lanes [0, lane_end), from our own deque, the
+    /// injection queue or another worker's deque; self is -1 off the pool
+    Task* find_task(int self, int lane_end = lanes) {
+        int const home = std::max(self, 0);
+        for (int lane = 0; lane < lane_end; ++lane) {
+            if (queued[lane].load(std::memory_order_relaxed) <= 0) continue;
+            Task* t = self >= 0 ? deques[self][lane].pop() : nullptr;
+            if (!t && injected_size[lane].load(std::memory_order_relaxed) > 0) {
+                std::lock_guard g(inject_mtx);
+                if (!injected[lane].empty()) {
+                    t = injected[lane].front();
+                    injected[lane].pop_front();
+                    injected_size[lane].store(injected[lane].size(),
+                                              std::memory_order_relaxed);
+                }
+            }
+            // Victims on our own node first, then the others
+            for (int pass = 0; pass < 2 && !t; ++pass) {
+                for (int k = 0; !t && k < workers; ++k) {
+                    int const v = (home + k) % workers;
+                    if (v != self && (worker_node[v] == worker_node[home]) == (pass == 0))
+                        t = deques[v][lane].steal();
+                }
+            }
+            if (t) {
+                queued[lane].fetch_sub(1);
+                pending.fetch_sub(1);
+                return t;
+            }
+        }
+        return nullptr;
+    }
+
+    /// Run t at its priority, unless its deadline has passed
+    static void run_task(Task* t) {
+        if (t->deadline != std::chrono::steady_clock::time_point::max()
+            && std::chrono::steady_clock::now() > t->deadline) {
+            t->expire();
+            return;
+        }
+        TaskPriority const outer = std::exchange(current_priority, t->priority);
+        trace::Span span("task", trace::work);
+        span.arg("wait_us", t->queued.elapsed_ns() / 1000);
+        t->run();
+        current_priority = outer;
+    }
+
+    /// Run the tasks queued with a more urgent priority than `p`
+    void run_urgent(TaskPriority p) {
+        for (int lane = 0; lane < int(p); ++lane) {
+            while (queued[lane].load(std::memory_order_relaxed) > 0) {
+                Task* t = find_task(worker_index(), lane + 1);
+                if (!t) break;
+                run_task(t);
+            }
+        }
+    }
 
-        while (1) {
-            std::unique_lock lock(tasks_mtx);
-            update.wait(lock,
-                        [this]() { return stop_flag || !tasks_queue.empty(); });
+    void thread_func(int self, int cpu) {
+        if (cpu >= 0) pin_current_thread(cpu);
+        trace::name_thread("worker", self);
+        current_pool   = this;
+        current_worker = self;
+        while (true) {
+            Task* t = nullptr;
+            for (int spin = 0; spin < 64 && !t && !stop_flag; ++spin) {
+                t = find_task(self);
+                if (!t) std::this_thread::yield();
+            }
             if (stop_flag) return;
+            if (t) {
+                run_task(t);
+                continue;
+            }
 
-            auto task = std::move(tasks_queue.front());
-            tasks_queue.pop_front();
-            lock.unlock();
-            task->call();
+            std::unique_lock lock(sleep_mtx);
+            sleeping.fetch_add(1);
+            wake.wait(lock, [this] { return stop_flag || pending.load() > 0; });
+            sleeping.fetch_sub(1);
+        }
+    }
+
+    /// Take back the helpers no worker started
+    void retract(std::array<Helper, max_helpers>& helpers, int count, Bulk& bulk) {
+        auto ours = [&](Task* t) {
+            return t >= helpers.data() && t < helpers.data() + count;
+        };
+        int const lane   = int(bulk.priority);
+        int taken        = 0;
+        int const self   = worker_index();
+        if (self >= 0) {
+            // Ours are at the bottom of this worker's deque unless stolen
+            for (int k = 0; k < count; ++k) {
+                Task* t = deques[self][lane].pop();
+                if (!t) break;
+                if (!ours(t)) {
+                    deques[self][lane].push(t);
+                    break;
+                }
+                ++taken;
+            }
+        }
+        if (injected_size[lane].load(std::memory_order_relaxed) > 0) {
+            std::lock_guard g(inject_mtx);
+            taken += std::erase_if(injected[lane], ours);
+            injected_size[lane].store(injected[lane].size(), std::memory_order_relaxed);
+        }
+        queued[lane].fetch_sub(taken);
+        pending.fetch_sub(taken);
+        bulk.unstarted.fetch_sub(taken);
+        bulk.helpers_done.count_down(taken);
+    }
+
+    /// Wait for the helpers of `bulk` to finish. While any is still queued,
+    /// run queued work up to the bulk's priority instead: a helper retract
+    /// could not reach, under tasks the pieces queued on this worker, may
+    /// otherwise be left to nobody, as on a 1-worker pool.
+    void join(Bulk& bulk) {
+        int const self = worker_index();
+        while (!bulk.helpers_done.try_wait()) {
+            if (Task* t = find_task(self, int(bulk.priority) + 1)) {
+                run_task(t);
+            } else if (bulk.unstarted.load() == 0) {
+                // The rest run on threads that wait the same way
+                bulk.helpers_done.wait();
+            } else {
+                std::this_thread::yield();
+            }
         }
     }
 
 public:
+    /// Sets the priority of the work the constructing thread submits until
+    /// it goes out of scope. Pool tasks run at the priority they were
+    /// submitted with, so nested parallel_for calls inherit it.
+    class PriorityScope {
+        TaskPriority outer;
+
+    public:
+        explicit PriorityScope(TaskPriority p)
+            : outer(std::exchange(current_priority, p)) {}
+        ~PriorityScope() { current_priority = outer; }
+        PriorityScope(PriorityScope const&)            = delete;
+        PriorityScope& operator=(PriorityScope const&) = delete;
+    };
+
+    /// Run f(i1, i2) over subranges covering [begin, end), at least `grain`
+    /// long but for the last, on the workers and the calling thread. Pieces
+    /// start large and shrink as the range runs out, so early claims are
+    /// cheap and the end still balances. Between pieces, threads run any
+    /// queued work more urgent than the calling thread's priority. Returns
+    /// when all are done and rethrows the first exception f threw; pieces
+    /// not yet started are then skipped.
+    template<class F>
+    void parallel_for(int begin, int end, F const& f, int grain = 1) {
+        if (begin >= end) return;
+        grain             = std::max(grain, 1);
+        int const pieces  = (end - begin + grain - 1) / grain;
+        int const helpers = std::min({workers, pieces - 1, max_helpers});
+        if (helpers <= 0) {
+            f(begin, end);
+            return;
+        }
+
+        auto body = [](void const* fp, int i1, int i2) {
+            (*static_cast<F const*>(fp))(i1, i2);
+        };
+        Bulk bulk(this, current_priority, body, &f, begin, end, grain,
+                  helpers + 1, helpers);
+        std::array<Helper, max_helpers> helper;
+        for (int k = 0; k < helpers; ++k) {
+            helper[k].bulk     = &bulk;
+            helper[k].priority = bulk.priority;
+            push(&helper[k]);
+        }
+        pending.fetch_add(helpers);
+        notify(helpers);
+
+        bulk.work();
+        retract(helper, helpers, bulk);
+        join(bulk);
+        if (bulk.error) std::rethrow_exception(bulk.error);
+    }
+
+    /// f(x1, y1, x2, y2) over tile_w x tile_h tiles covering a w x h area,
+    /// clipped at its right and bottom edges, as in parallel_for
+    template<class F>
+    void parallel_for_2d(int w, int h, int tile_w, int tile_h, F const& f) {
+        if (w <= 0 || h <= 0) return;
+        int const cols = (w + tile_w - 1) / tile_w;
+        int const rows = (h + tile_h - 1) / tile_h;
+        parallel_for(0, cols * rows, [&](int t1, int t2) {
+            for (int t = t1; t < t2; ++t) {
+                int const x = t % cols * tile_w, y = t / cols * tile_h;
+                f(x, y, std::min(x + tile_w, w), std::min(y + tile_h, h));
+            }
+        });
+    }
+
+    /// Run f(as...) as one task at the calling thread's priority
     template<class F, class... As>
     std::future<std::invoke_result_t<F, As...>> queue(F&& f, As&&... as) {
+        return queue(TaskOptions{.priority = current_priority}, std::forward<F>(f),
+                     std::forward<As>(as)...);
+    }
+
+    /// Run f(as...) as one task with `opts`. When no worker has started it
+    /// by the deadline it is dropped and the future throws task_expired.
+    template<class F, class... As>
+    std::future<std::invoke_result_t<F, As...>> queue(TaskOptions const& opts,
+                                                      F&& f, As&&... as) {
         using R = std::invoke_result_t<F, As...>;
 
         std::promise<R> pr;
         auto ft = pr.get_future();
 
-        struct FUNC: F_BASE {
+        struct FUNC final : Task {
             std::promise<R> pr_;
             std::decay_t<F> f_;
             std::tuple<std::decay_t<As>...> as_;
 
-            void call() override {
+            void run() override {
                 try {
                     if constexpr (std::is_void_v<R>) {
                         std::apply(std::move(f_), std::move(as_));
@@ -57,6 +493,13 @@ public:
                             std::apply(std::move(f_), std::move(as_)));
                     }
                 } catch (...) { pr_.set_exception(std::current_exception()); }
+                delete this;
+            }
+            // The future reports a broken promise
+            void discard() override { delete this; }
+            void expire() override {
+                pr_.set_exception(std::make_exception_ptr(task_expired()));
+                delete this;
             }
 
             FUNC(std::promise<R>&& pr, F&& f, As&&... as)
@@ -64,26 +507,43 @@ public:
                   as_(std::forward_as_tuple(std::forward<As>(as)...)) {}
         };
 
-        auto func = std::make_unique<FUNC>(std::move(pr), std::forward<F>(f),
-                                           std::forward<As>(as)...);
-
-        {
-            std::lock_guard g(tasks_mtx);
-            tasks_queue.push_back(std::move(func));
-        }
-        update.notify_one();
-
+        auto* task     = new FUNC(std::move(pr), std::forward<F>(f), std::forward<As>(as)...);
+        task->priority = opts.priority;
+        task->deadline = opts.deadline;
+        submit(task);
         return ft;
     }
+
     ~ThreadPool() {
-        stop_flag = true;
-        update.notify_all();
+        {
+            std::lock_guard g(sleep_mtx);
+            stop_flag = true;
+        }
+        wake.notify_all();
         for (auto& t : threads) t.join();
+        for (auto& lane : injected) {
+            for (Task* t : lane) t->discard();
+        }
+        for (int i = 0; i < size(); ++i) {
+            for (auto& d : deques[i]) {
+                while (Task* t = d.steal()) t->discard();
+            }
+        }
     }
-    explicit ThreadPool(int n) {
-        threads.reserve(n);
-        for (int i = 0; i < n; ++i)
-            threads.push_back(std::thread(&ThreadPool::thread_func, this));
-    }
-    explicit ThreadPool(): ThreadPool(std::thread::hardware_concurrency()) {}
+    explicit ThreadPool(PoolOptions const& opts);
+    explicit ThreadPool(int n): ThreadPool(PoolOptions{.threads = n}) {}
+    explicit ThreadPool(): ThreadPool(PoolOptions{}) {}
+
+    ThreadPool(ThreadPool const&)            = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    int size() const { return workers; }
+
+    /// The process-wide pool, started on first use. Sharing it keeps
+    /// renderers from spawning and tearing down threads of their own and
+    /// from oversubscribing the machine.
+    static ThreadPool& shared();
+    /// Options shared() starts the pool with. Throws std::logic_error once
+    /// it has started.
+    static void configure_shared(PoolOptions const& opts);
 };
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <render_job.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/// Identifies a tile of escape times: its cell on the world-space grid of a
+/// zoom level and everything else that changes its contents
+struct TileKey {
+    double scale;  // the zoom level
+    int max_iters;
+    MandelAlgorithm algorithm;
+    bool subdivide;
+    KernelPrecision precision;  // resolved, never AUTO
+    std::int64_t x;  // tile column, world x * scale / tile_size
+    std::int64_t y;
+
+    friend bool operator==(TileKey const&, TileKey const&) = default;
+};
+
+struct TileKeyHash {
+    std::size_t operator()(TileKey const& k) const noexcept;
+};
+
+/// Position of the viewport's top-left pixel on the global pixel grid of
+/// its zoom level (world * scale), when it sits on a whole pixel of that grid
+std::optional<std::array<std::int64_t, 2>> grid_origin(Viewport const& v);
+
+/// Least-recently-used cache of tile_size x tile_size escape-time tiles,
+/// bounded by a memory budget. Safe to share between threads.
+class TileCache {
+public:
+    static constexpr int tile_size = 64;
+    static constexpr std::size_t default_budget = std::size_t(256) << 20;
+
+    using Tile = std::shared_ptr<std::vector<int> const>;
+
+    struct Stats {
+        long hits      = 0;
+        long misses    = 0;
+        long evictions = 0;
+    };
+
+    explicit TileCache(std::size_t budget_bytes = default_budget)
+        : budget(budget_bytes) {}
+
+    /// The tile for `key`, marked most recently used, or null
+    Tile find(TileKey const& key);
+    /// Store a tile_size * tile_size row-major tile, evicting the least
+    /// recently used ones beyond the budget
+    void insert(TileKey const& key, std::vector<int> tile);
+
+    /// Shrinking the budget evicts right away; 0 disables the cache
+    void set_budget(std::size_t bytes);
+    std::size_t get_budget() const;
+    std::size_t memory_used() const;
+    void clear();
+
+    Stats stats() const;
+
+private:
+    using Entry = std::pair<TileKey, Tile>;
+
+    mutable std::mutex mtx;
+    std::size_t budget;
+    std::size_t used = 0;
+    std::list<Entry> lru;  // front is the most recently used
+    std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> index;
+    Stats counters;
+
+    static std::size_t cost(Tile const& t);
+    void evict();
+};
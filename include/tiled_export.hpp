@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/// An 8-bit RGB image written tile by tile into an uncompressed, tiled
+/// BigTIFF, so that memory use does not depend on the image size. Every
+/// tile has a fixed place in the file and goes there with one positional
+/// write.
+///
+/// Finished tiles are recorded in PATH.progress once they are on disk.
+/// Opening the same path with the same signature again resumes an
+/// interrupted export: done() tells which tiles to skip. A different
+/// signature, or a missing progress file, starts over.
+class TiledExport {
+    std::string path;
+    int width, height, tile;
+    int columns, rows;
+    std::uint64_t data_offset = 0;  // of tile 0; the others follow in order
+
+    int fd          = -1;
+    int progress_fd = -1;
+    std::size_t progress_header = 0;  // bytes before the tile flags
+    std::vector<char> finished;       // per tile, '1' once on disk
+    std::vector<int> unrecorded;      // written since the last checkpoint
+    bool resumed_ = false;
+
+    std::chrono::steady_clock::time_point last_checkpoint;
+    static constexpr std::chrono::seconds checkpoint_interval{5};
+
+    void create(std::string const& signature);
+    bool resume(std::string const& signature);
+
+public:
+    /// `tile` must be a positive multiple of 16, as TIFF requires.
+    /// Throws std::invalid_argument for bad sizes and std::system_error
+    /// when the files cannot be created.
+    TiledExport(std::string path, int w, int h, int tile, std::string const& signature);
+    /// Records the tiles written so far, so a failed export still resumes
+    ~TiledExport();
+    TiledExport(TiledExport const&)            = delete;
+    TiledExport& operator=(TiledExport const&) = delete;
+
+    int tile_size() const { return tile; }
+    int tile_count() const { return columns * rows; }
+    /// Top-left pixel of tile i; tiles are numbered row-major
+    int tile_x(int i) const { return i % columns * tile; }
+    int tile_y(int i) const { return i / columns * tile; }
+
+    /// Whether tile i is stored, by this run or the one resumed
+    bool done(int i) const { return finished[i] == '1'; }
+    int done_count() const;
+    /// Whether tiles of an earlier run were kept
+    bool resumed() const { return resumed_; }
+
+    /// Store tile i: tile x tile pixels, rows of 3 * tile bytes. Parts
+    /// beyond the image edge are stored too, as TIFF pads edge tiles.
+    /// Checkpoints every few seconds.
+    void write_tile(int i, std::span<std::uint8_t const> rgb);
+    /// Flush the written tiles to disk, then record them as finished
+    void checkpoint();
+    /// Checkpoint and remove the progress file: the image is complete
+    void finish();
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/// CPUs this process may run on, grouped by NUMA node
+struct CpuTopology {
+    std::vector<std::vector<int>> nodes;
+
+    int cpu_count() const;
+    /// Node of `cpu`, or -1 when the process may not run on it
+    int node_of(int cpu) const;
+};
+
+/// Read once from /sys and the affinity mask at startup. Where NUMA
+/// information is unavailable all allowed CPUs form a single node.
+CpuTopology const& cpu_topology();
+
+/// Restrict the calling thread to `cpu`. False where unsupported or refused.
+bool pin_current_thread(int cpu);
+
+/// Drop the memory pages lying wholly within [p, p + bytes) so that each is
+/// faulted back in on the NUMA node of the first thread to touch it. The
+/// contents of the range are undefined afterwards, and the caller must write
+/// it before reading it. Only for anonymous memory the caller owns. A no-op
+/// off Linux.
+void release_pages(void* p, std::size_t bytes);
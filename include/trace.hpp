@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// Timing spans of the render hot paths, kept per thread in bounded ring
+/// buffers and exported as Chrome trace JSON for chrome://tracing or
+/// ui.perfetto.dev. Configure with -DENABLE_TRACING=ON to record; otherwise
+/// Span and Stamp are empty and every call here compiles to nothing.
+namespace trace {
+
+#ifdef FRACTAL_TRACING
+inline constexpr bool enabled = true;
+#else
+inline constexpr bool enabled = false;
+#endif
+
+/// Category of the spans summarize() reports per name: preview, compute,
+/// colorize, present, ...
+inline constexpr char const* phase = "phase";
+/// Category of spans spent working, from which summarize() derives thread
+/// utilization
+inline constexpr char const* work = "work";
+
+struct Event {
+    char const* name;      // string literals only
+    char const* category;
+    std::int64_t start_ns;
+    std::int64_t duration_ns;
+    int thread;
+    /// Up to two named integers; unused ones have a null name
+    std::array<std::pair<char const*, std::int64_t>, 2> args;
+};
+
+#ifdef FRACTAL_TRACING
+
+/// Steady-clock nanoseconds, the time base of all events
+std::int64_t now_ns();
+
+/// Records [construction, destruction) on the calling thread
+class Span {
+    Event ev;
+
+public:
+    Span(char const* name, char const* category);
+    ~Span();
+    Span(Span const&)            = delete;
+    Span& operator=(Span const&) = delete;
+
+    void arg(char const* name, std::int64_t value);
+};
+
+/// A moment to measure from, such as when a task was queued
+class Stamp {
+    std::int64_t ns = 0;
+
+public:
+    void set() { ns = now_ns(); }
+    std::int64_t elapsed_ns() const { return now_ns() - ns; }
+};
+
+/// Name the calling thread in the trace, with `index` appended unless -1
+void name_thread(std::string_view name, int index = -1);
+
+/// Events recorded by all threads that started at or after t0
+std::vector<Event> events_since(std::int64_t t0 = 0);
+
+void clear();
+
+#else
+
+inline std::int64_t now_ns() { return 0; }
+
+class Span {
+public:
+    Span(char const*, char const*) {}
+    Span(Span const&)            = delete;
+    Span& operator=(Span const&) = delete;
+    void arg(char const*, std::int64_t) {}
+};
+
+class Stamp {
+public:
+    void set() {}
+    std::int64_t elapsed_ns() const { return 0; }
+};
+
+inline void name_thread(std::string_view, int = -1) {}
+inline std::vector<Event> events_since(std::int64_t = 0) { return {}; }
+inline void clear() {}
+
+#endif
+
+/// All recorded events and thread names as Chrome trace JSON; an empty
+/// trace when built without tracing
+void write_chrome_trace(std::ostream& os);
+
+/// Where a frame's time went
+struct FrameStats {
+    /// Time in each phase span, less the phases nested in it, in order of
+    /// first appearance
+    std::vector<std::pair<char const*, double>> phase_ms;
+    /// Share of [t0, t1) that `threads` threads spent in work spans
+    double utilization = 0;
+};
+
+FrameStats summarize(std::span<Event const> events, std::int64_t t0,
+                     std::int64_t t1, int threads);
+
+}  // namespace trace
@@ -0,0 +1,229 @@
+#include <animation.hpp>
+
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef FRACTAL_PNG
+#include <png.h>
+#endif
+
+namespace {
+
+struct KeyframeLine {
+    int line      = 0;
+    int frame     = 0;
+    std::string x = {}, y = {};
+    double scale  = 0;
+    int max_iters = 0;
+};
+
+std::invalid_argument keyframe_error(int line, std::string const& what) {
+    return std::invalid_argument("keyframe line " + std::to_string(line) + ": " + what);
+}
+
+#ifdef FRACTAL_PNG
+
+/// Fast zlib settings: frames are written far more often than read, and
+/// beyond level 1 the size barely shrinks
+std::string encode_png(std::span<std::uint8_t const> rgb, int w, int h) {
+    std::string out;
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                              nullptr, nullptr);
+    png_infop info  = png ? png_create_info_struct(png) : nullptr;
+    if (!info) {
+        png_destroy_write_struct(&png, nullptr);
+        throw std::bad_alloc();
+    }
+    // libpng reports errors by jumping back here
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        throw std::runtime_error("PNG encoding failed");
+    }
+    png_set_write_fn(
+        png, &out,
+        [](png_structp p, png_bytep data, png_size_t n) {
+            static_cast<std::string*>(png_get_io_ptr(p))
+                ->append(reinterpret_cast<char const*>(data), n);
+        },
+        nullptr);
+    png_set_IHDR(png, info, w, h, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_compression_level(png, 1);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+    png_write_info(png, info);
+    for (int y = 0; y < h; ++y)
+        png_write_row(png, rgb.data() + std::size_t(3) * w * y);
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    return out;
+}
+
+#endif
+
+}  // namespace
+
+std::vector<Keyframe> parse_keyframes(std::istream& is) {
+    std::vector<KeyframeLine> lines;
+    std::string text;
+    for (int number = 1; std::getline(is, text); ++number) {
+        std::istringstream ls(text);
+        std::string frame, extra;
+        if (!(ls >> frame) || frame[0] == '#') continue;
+
+        KeyframeLine l{.line = number};
+        auto [end, ec] = std::from_chars(frame.data(), frame.data() + frame.size(), l.frame);
+        if (ec != std::errc{} || end != frame.data() + frame.size()
+            || !(ls >> l.x >> l.y >> l.scale >> l.max_iters) || ls >> extra)
+            throw keyframe_error(number, "expected FRAME X Y SCALE MAX_ITERS");
+        if (l.scale <= 0 || l.max_iters <= 0)
+            throw keyframe_error(number, "scale and max_iters must be positive");
+        if (lines.empty() ? l.frame != 0 : l.frame <= lines.back().frame)
+            throw keyframe_error(number, "frames must start at 0 and increase");
+        lines.push_back(std::move(l));
+    }
+    if (lines.empty()) throw std::invalid_argument("no keyframes");
+
+    // Centres carry the digits the deepest keyframe needs
+    double max_scale = 0;
+    for (auto const& l : lines) max_scale = std::max(max_scale, l.scale);
+    unsigned const bits = precision_for_scale(max_scale);
+
+    std::vector<Keyframe> keys;
+    for (auto const& l : lines) {
+        try {
+            keys.push_back({l.frame, PrecisePoint(mpf_class(l.x, bits), mpf_class(l.y, bits)),
+                            l.scale, l.max_iters});
+        } catch (std::invalid_argument const&) {
+            throw keyframe_error(l.line, "invalid centre");
+        }
+    }
+    return keys;
+}
+
+std::vector<FrameView> interpolate_keyframes(std::span<Keyframe const> keys) {
+    std::vector<FrameView> views;
+    if (keys.empty()) return views;
+    views.push_back({keys[0].center, keys[0].scale, keys[0].max_iters});
+    for (std::size_t k = 1; k < keys.size(); ++k) {
+        Keyframe const& a   = keys[k - 1];
+        Keyframe const& b   = keys[k];
+        unsigned const bits = precision_for_scale(std::max(a.scale, b.scale));
+        mpf_class const dx(b.center.x - a.center.x, bits);
+        mpf_class const dy(b.center.y - a.center.y, bits);
+
+        int const frames = b.frame - a.frame;
+        for (int f = 1; f < frames; ++f) {
+            double const t     = double(f) / frames;
+            double const scale = a.scale * std::pow(b.scale / a.scale, t);
+            // Share of the way from a's centre to b's. The deeper centre's
+            // distance from the middle of the screen, in pixels, then
+            // changes linearly: (1 - s) * |b - a| * scale when zooming in.
+            double const s = b.scale >= a.scale ? 1 - (1 - t) * a.scale / scale
+                                                : t * b.scale / scale;
+            PrecisePoint const center(mpf_class(a.center.x + dx * s, bits),
+                                      mpf_class(a.center.y + dy * s, bits));
+            int const max_iters = std::lround(a.max_iters + (b.max_iters - a.max_iters) * t);
+            views.push_back({center, scale, max_iters});
+        }
+        views.push_back({b.center, b.scale, b.max_iters});
+    }
+    return views;
+}
+
+Viewport frame_viewport(FrameView const& view, int w, int h) {
+    PrecisePoint top_left = view.center;
+    top_left.set_precision(precision_for_scale(view.scale));
+    top_left -= vec2{w, h} / (2 * view.scale);
+    return Viewport{
+        .top_left         = top_left.to_vec2(),
+        .scale            = view.scale,
+        .precise_top_left = top_left,
+    };
+}
+
+ImageFiles::ImageFiles(std::string pattern_, ImageFormat format_)
+    : pattern(std::move(pattern_)), format(format_) {
+    if (pattern.find('#') == std::string::npos)
+        throw std::invalid_argument("file name pattern '" + pattern
+                                    + "' has no # for the frame number");
+#ifndef FRACTAL_PNG
+    if (format == ImageFormat::PNG)
+        throw std::invalid_argument("PNG output needs a build with libpng");
+#endif
+}
+
+std::string ImageFiles::path(int frame) const {
+    std::size_t const pos = pattern.find('#');
+    std::size_t const len = pattern.find_first_not_of('#', pos) - pos;
+    std::string number    = std::to_string(frame);
+    if (number.size() < len) number.insert(0, len - number.size(), '0');
+    return pattern.substr(0, pos) + number + pattern.substr(std::min(pos + len, pattern.size()));
+}
+
+std::string ImageFiles::encode(std::span<std::uint8_t const> rgb, int w, int h) const {
+#ifdef FRACTAL_PNG
+    if (format == ImageFormat::PNG) return encode_png(rgb, w, h);
+#endif
+    std::string out = "P6\n" + std::to_string(w) + ' ' + std::to_string(h) + "\n255\n";
+    out.append(reinterpret_cast<char const*>(rgb.data()), rgb.size());
+    return out;
+}
+
+void ImageFiles::write(int frame, std::string const& bytes) {
+    std::string const name = path(frame);
+    std::ofstream out(name, std::ios::binary);
+    out.write(bytes.data(), bytes.size());
+    if (!out) throw std::runtime_error("failed to write " + name);
+}
+
+Y4mStream::Y4mStream(std::ostream& out, int w, int h, int frames_per_second)
+    : os(out), width(w), height(h), fps(frames_per_second) {
+    if (w % 2 || h % 2)
+        throw std::invalid_argument("Y4M output needs an even width and height");
+    if (fps <= 0) throw std::invalid_argument("frame rate must be positive");
+}
+
+std::string Y4mStream::encode(std::span<std::uint8_t const> rgb, int w, int h) const {
+    if (w != width || h != height)
+        throw std::invalid_argument("frame size differs from the stream's");
+    // BT.709 in limited range, chroma averaged over 2 x 2 pixels
+    std::string out = "FRAME\n";
+    std::size_t const header = out.size();
+    out.resize(header + std::size_t(w) * h * 3 / 2);
+    auto* const luma = reinterpret_cast<std::uint8_t*>(out.data() + header);
+    auto* const cb   = luma + std::size_t(w) * h;
+    auto* const cr   = cb + std::size_t(w / 2) * (h / 2);
+    for (std::size_t i = 0; i < std::size_t(w) * h; ++i) {
+        int const r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        luma[i]     = 16 + ((47 * r + 157 * g + 16 * b + 128) >> 8);
+    }
+    for (int y = 0; y < h / 2; ++y) {
+        for (int x = 0; x < w / 2; ++x) {
+            int r = 0, g = 0, b = 0;
+            for (int k = 0; k < 4; ++k) {
+                std::size_t const i = std::size_t(2 * y + k / 2) * w + 2 * x + k % 2;
+                r += rgb[3 * i];
+                g += rgb[3 * i + 1];
+                b += rgb[3 * i + 2];
+            }
+            std::size_t const c = std::size_t(y) * (w / 2) + x;
+            cb[c] = 128 + ((-26 * r - 86 * g + 112 * b + 512) >> 10);
+            cr[c] = 128 + ((112 * r - 102 * g - 10 * b + 512) >> 10);
+        }
+    }
+    return out;
+}
+
+void Y4mStream::write(int, std::string const& bytes) {
+    if (!header_written) {
+        os << "YUV4MPEG2 W" << width << " H" << height << " F" << fps
+           << ":1 Ip A1:1 C420jpeg\n";
+        header_written = true;
+    }
+    os.write(bytes.data(), bytes.size());
+    if (!os) throw std::runtime_error("failed to write the Y4M stream");
+}
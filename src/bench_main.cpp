@@ -0,0 +1,315 @@
+#include <mandel_engine.hpp>
+#include <math_tools.hpp>
+#include <newton_engine.hpp>
+#include <simd_kernels.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <numbers>
+#include <numeric>
+
+// Kernel and engine timings over a fixed corpus of viewports, so numbers
+// compare across builds and machines. Build in Release; filter with
+// --benchmark_filter, e.g. 'line_kernel/.*view:1'.
+
+namespace {
+
+/// A square region of the plane, `width` world units across
+struct NamedView {
+    char const* name;
+    vec2 center;
+    double width;
+};
+
+std::array<NamedView, 4> const corpus = {{
+    {"full", {-0.5, 0}, 3.0},
+    {"seahorse", {-0.745, 0.11}, 0.02},
+    // Inside the main cardioid, where every orbit runs to max_iters
+    {"interior", {-0.2, 0}, 0.4},
+    // Filaments near a minibrot, escape times vary pixel to pixel
+    {"boundary", {-0.7436447860, 0.1318252536}, 3e-5},
+}};
+
+MandelJob corpus_job(int view, int size, int mx,
+                     MandelAlgorithm alg = MandelAlgorithm::AVX512) {
+    NamedView const& v = corpus[view];
+    return MandelJob{
+        .viewport  = {.top_left = v.center - vec2{v.width, v.width} / 2,
+                      .scale    = size / v.width},
+        .width     = size,
+        .height    = size,
+        .max_iters = mx,
+        .algorithm = alg,
+    };
+}
+
+/// The same job moved by half a pixel every other call, so the engine
+/// cannot reuse the previous frame while the work stays the same
+template<class Job>
+Job jiggled(Job job, std::int64_t i) {
+    if (i % 2) job.viewport.top_left.x() += job.viewport.pixel_size() / 2;
+    return job;
+}
+
+/// Pixels and iterations per second of wall time. Iterations are the sum
+/// of the escape times, what a plain loop would run; the bulb test and
+/// period detection skip many of them inside the set.
+void report(benchmark::State& state, double pixels, double iters) {
+    auto const n = double(state.iterations());
+    state.counters["pixels/s"] = benchmark::Counter(pixels * n, benchmark::Counter::kIsRate);
+    if (iters > 0)
+        state.counters["iters/s"] = benchmark::Counter(iters * n, benchmark::Counter::kIsRate);
+}
+
+/// Workers besides the calling thread, which works too
+ThreadPool pool_for(benchmark::State const& state, int threads_arg) {
+    return ThreadPool(std::max(int(state.range(threads_arg)) - 1, 0));
+}
+
+/// One thread and the whole machine
+std::vector<std::int64_t> thread_counts() {
+    int const all = cpu_topology().cpu_count();
+    if (all > 1) return {1, all};
+    return {1};
+}
+
+// Arguments: view, size, max_iters, threads
+void corpus_args(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"view", "size", "iters", "threads"})
+        ->ArgsProduct({{0, 1, 2, 3}, {256, 1024}, {256, 4096}, thread_counts()})
+        ->UseRealTime();
+}
+
+double sum(std::span<int const> iters) {
+    return std::accumulate(iters.begin(), iters.end(), 0.0);
+}
+
+/// Scalar escape times, iters_for per pixel
+void BM_iters_for(benchmark::State& state) {
+    int const view = state.range(0), size = state.range(1), mx = state.range(2);
+    ThreadPool tpool = pool_for(state, 3);
+    MandelbrotEngine engine(tpool);
+    engine.tile_cache().set_budget(0);
+    MandelJob const job = corpus_job(view, size, mx, MandelAlgorithm::OPTIMIZED);
+
+    auto first         = engine.escape_times(job);
+    double const iters = sum(first);
+    engine.recycle(std::move(first));
+    std::int64_t i = 0;
+    for (auto _ : state) {
+        auto res = engine.escape_times(jiggled(job, ++i));
+        benchmark::DoNotOptimize(res.data());
+        engine.recycle(std::move(res));
+    }
+    state.SetLabel(corpus[view].name);
+    report(state, double(size) * size, iters);
+}
+BENCHMARK(BM_iters_for)->Apply(corpus_args);
+
+/// One line kernel on a single thread, line after line
+void BM_line_kernel(benchmark::State& state) {
+    auto const level   = SimdLevel(state.range(0));
+    bool const single  = state.range(1);
+    int const view     = state.range(2);
+    int const size     = state.range(3);
+    int const mx       = state.range(4);
+    if (level > detected_simd_level()) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    line_kernel* const kernel = line_kernel_for(level, single);
+    MandelJob const job       = corpus_job(view, size, mx);
+
+    std::vector<int> res(std::size_t(size) * size);
+    auto render = [&] {
+        for (int y = 0; y < size; ++y) {
+            vec2 const l = job.viewport.screen_to_world({0, y});
+            vec2 const r = job.viewport.screen_to_world({size, y});
+            kernel(res.data() + std::size_t(y) * size, l.x(), r.x(), l.y(), size, mx, {});
+        }
+    };
+    render();
+    double const iters = sum(res);
+    for (auto _ : state) {
+        render();
+        benchmark::DoNotOptimize(res.data());
+    }
+    state.SetLabel(std::string(simd_level_name(level)) + (single ? " float " : " double ")
+                   + corpus[view].name);
+    report(state, double(size) * size, iters);
+}
+BENCHMARK(BM_line_kernel)->Apply([](benchmark::internal::Benchmark* b) {
+    b->ArgNames({"level", "single", "view", "size", "iters"});
+    for (int level : {0, 1, 2}) {
+        for (int single : {0, 1}) {
+            for (int view = 0; view < int(corpus.size()); ++view) {
+                b->Args({level, single, view, 512, 1024});
+            }
+        }
+    }
+});
+
+/// The whole SIMD path: probe, cost-balanced chunks, kernels on the pool
+void BM_simd_escape_times(benchmark::State& state) {
+    int const view = state.range(0), size = state.range(1), mx = state.range(2);
+    ThreadPool tpool = pool_for(state, 3);
+    MandelbrotEngine engine(tpool);
+    engine.tile_cache().set_budget(0);
+    MandelJob const job = corpus_job(view, size, mx);
+
+    auto first         = engine.escape_times(job);
+    double const iters = sum(first);
+    engine.recycle(std::move(first));
+    std::int64_t i = 0;
+    for (auto _ : state) {
+        auto res = engine.escape_times(jiggled(job, ++i));
+        benchmark::DoNotOptimize(res.data());
+        engine.recycle(std::move(res));
+    }
+    state.SetLabel(MandelbrotEngine::kernel_name(job) + " " + corpus[view].name);
+    report(state, double(size) * size, iters);
+}
+BENCHMARK(BM_simd_escape_times)->Apply(corpus_args);
+
+/// Double-double kernels against perturbation, the views between double
+/// and arbitrary precision. Arguments: pixel spacing 1e-depth, perturbation,
+/// size, max_iters, threads.
+void BM_deep_zoom(benchmark::State& state) {
+    int const depth    = state.range(0);
+    bool const perturb = state.range(1);
+    int const size = state.range(2), mx = state.range(3);
+    ThreadPool tpool = pool_for(state, 4);
+    MandelbrotEngine engine(tpool);
+    engine.tile_cache().set_budget(0);
+
+    double const scale  = std::pow(10.0, depth);
+    unsigned const bits = precision_for_scale(scale);
+    PrecisePoint tl(mpf_class("-0.743643887037158704752191506114774", bits),
+                    mpf_class("0.131825904205311970493132056385139", bits));
+    tl -= vec2{size, size} / (2 * scale);
+    MandelJob const job{
+        .viewport  = {.top_left = tl.to_vec2(), .scale = scale, .precise_top_left = tl},
+        .width     = size,
+        .height    = size,
+        .max_iters = mx,
+        .algorithm = perturb ? MandelAlgorithm::DEEP_ZOOM : MandelAlgorithm::AVX512,
+    };
+    // As jiggled, on the corner deep zooms go by
+    auto moved = [&](std::int64_t i) {
+        MandelJob j = job;
+        if (i % 2) *j.viewport.precise_top_left += vec2{j.viewport.pixel_size() / 2, 0};
+        return j;
+    };
+
+    auto first         = engine.escape_times(job);
+    double const iters = sum(first);
+    engine.recycle(std::move(first));
+    std::int64_t i = 0;
+    for (auto _ : state) {
+        auto res = engine.escape_times(moved(++i));
+        benchmark::DoNotOptimize(res.data());
+        engine.recycle(std::move(res));
+    }
+    state.SetLabel(MandelbrotEngine::kernel_name(job));
+    report(state, double(size) * size, iters);
+}
+BENCHMARK(BM_deep_zoom)
+    ->ArgNames({"depth", "perturb", "size", "iters", "threads"})
+    ->ArgsProduct({{14, 20, 27}, {0, 1}, {256}, {10000}, thread_counts()})
+    ->UseRealTime();
+
+/// Newton iteration on z^3 - 1 over [-2, 2]^2
+void BM_newton(benchmark::State& state) {
+    int const size = state.range(0), mx = state.range(1);
+    ThreadPool tpool = pool_for(state, 2);
+    NewtonEngine engine(tpool);
+
+    std::vector<math::complex> const coeffs = {-1, 0, 0, 1};
+    math::Polynomial const p(coeffs);
+    NewtonJob const job{
+        .viewport   = {.top_left = {-2, -2}, .scale = size / 4.0},
+        .width      = size,
+        .height     = size,
+        .max_iters  = mx,
+        .polynomial = p,
+        .derivative = math::derivative(p),
+        .roots      = math::find_roots(p, 1e-10),
+    };
+
+    auto first   = engine.escape_times(job);
+    double iters = 0;
+    for (auto const& pt : first) iters += pt.iterations;
+    engine.recycle(std::move(first));
+    std::int64_t i = 0;
+    for (auto _ : state) {
+        auto res = engine.escape_times(jiggled(job, ++i));
+        benchmark::DoNotOptimize(res.data());
+        engine.recycle(std::move(res));
+    }
+    report(state, double(size) * size, iters);
+}
+BENCHMARK(BM_newton)
+    ->ArgNames({"size", "iters", "threads"})
+    ->ArgsProduct({{256, 1024}, {64}, thread_counts()})
+    ->UseRealTime();
+
+/// Polynomial with roots on the unit circle
+math::Polynomial circle_polynomial(int degree) {
+    std::vector<math::complex> roots;
+    for (int k = 0; k < degree; ++k) roots.push_back(std::polar(1.0, 2 * std::numbers::pi * (k + 0.5) / degree));
+    return math::Polynomial::from_roots(roots);
+}
+
+void BM_polynomial_eval(benchmark::State& state) {
+    math::Polynomial const p = circle_polynomial(state.range(0));
+    math::complex z(0.3, 0.4), acc = 0;
+    for (auto _ : state) {
+        acc += p(z);
+        z *= math::complex(0.999, 0.001);
+        benchmark::DoNotOptimize(acc);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_polynomial_eval)->ArgName("degree")->Arg(3)->Arg(6)->Arg(10);
+
+void BM_find_roots(benchmark::State& state) {
+    math::Polynomial const p = circle_polynomial(state.range(0));
+    for (auto _ : state) benchmark::DoNotOptimize(math::find_roots(p, 1e-10));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_find_roots)->ArgName("degree")->Arg(3)->Arg(6)->Arg(10);
+
+/// Colouring the escape times of a full-set frame
+void BM_colorize(benchmark::State& state) {
+    auto const alg    = MandelAlgorithm(state.range(0));
+    auto const format = PixelFormat(state.range(1));
+    int const size    = state.range(2);
+    ThreadPool tpool  = pool_for(state, 3);
+    MandelbrotEngine engine(tpool);
+    MandelJob const job    = corpus_job(0, size, 1024, alg);
+    auto const iters = engine.escape_times(job);
+
+    int const stride = size * bytes_per_pixel(format);
+    std::vector<std::uint8_t> data(std::size_t(stride) * size);
+    for (auto _ : state) {
+        engine.colorize(job, iters, data.data(), stride, format);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetLabel(alg == MandelAlgorithm::HISTOGRAM         ? "histogram"
+                   : alg == MandelAlgorithm::BLACK_AND_WHITE ? "black and white"
+                                                             : "hue");
+    report(state, double(size) * size, 0);
+}
+BENCHMARK(BM_colorize)
+    ->ArgNames({"alg", "format", "size", "threads"})
+    ->ArgsProduct({{int(MandelAlgorithm::AVX2), int(MandelAlgorithm::HISTOGRAM),
+                    int(MandelAlgorithm::BLACK_AND_WHITE)},
+                   {int(PixelFormat::RGB), int(PixelFormat::ARGB32)},
+                   {1024, 4096},
+                   thread_counts()})
+    ->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,1217 @@
+#include <animation.hpp>
+#include <async_render.hpp>
+#include <frame_reuse.hpp>
+#include <mandel_engine.hpp>
+#include <newton_engine.hpp>
+#include <palette.hpp>
+#include <partition.hpp>
+#include <perturbation.hpp>
+#include <tile_cache.hpp>
+#include <tiled_export.hpp>
+#include <trace.hpp>
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+MandelJob make_job(MandelAlgorithm alg, int w = 67, int h = 45, int mx = 200) {
+    return MandelJob{
+        .viewport  = {.top_left = {-2, -1.2}, .scale = w / 2.6},
+        .width     = w,
+        .height    = h,
+        .max_iters = mx,
+        .algorithm = alg,
+    };
+}
+
+int count_differences(std::span<int const> a, std::span<int const> b) {
+    int diff = 0;
+    for (size_t i = 0; i < a.size(); ++i) diff += a[i] != b[i];
+    return diff;
+}
+
+#ifdef __linux__
+/// Page faults taken so far by the calling thread
+long minor_faults() {
+    rusage ru{};
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_minflt;
+}
+#endif
+
+/// Escape time by plain iteration, with neither the bulb test nor cycle
+/// detection, in T. `fused` rounds 2 x y + cy once, as the FMA kernels do.
+template<class T>
+int plain_iters_for(T cx, T cy, int mx, bool fused) {
+    T x = 0, y = 0;
+    int iters = 0;
+    for (; iters < mx; ++iters) {
+        T const x2 = x * x, y2 = y * y;
+        if (x2 + y2 > 4) break;
+        y = fused ? std::fma(x + x, y, cy) : (x + x) * y + cy;
+        x = x2 - y2 + cx;
+    }
+    return iters;
+}
+
+/// Escape time iterated entirely in arbitrary precision
+int precise_iters_for(PrecisePoint const& c, int mx) {
+    unsigned const bits = c.x.get_prec();
+    mpf_class x(0, bits), y(0, bits), x2(0, bits), y2(0, bits), xy(0, bits);
+    int iters = 0;
+    for (; iters < mx; ++iters) {
+        if (x2 + y2 > 4) break;
+        xy = x * y;
+        y  = xy + xy + c.y;
+        x  = x2 - y2 + c.x;
+        x2 = x * x;
+        y2 = y * y;
+    }
+    return iters;
+}
+
+MandelJob make_deep_job(char const* x, char const* y, double scale, int size,
+                        int mx) {
+    unsigned const bits = precision_for_scale(scale);
+    PrecisePoint tl(mpf_class(x, bits), mpf_class(y, bits));
+    tl -= vec2{size, size} / (2 * scale);
+    return MandelJob{
+        .viewport  = {.top_left         = tl.to_vec2(),
+                      .scale            = scale,
+                      .precise_top_left = tl},
+        .width     = size,
+        .height    = size,
+        .max_iters = mx,
+        .algorithm = MandelAlgorithm::DEEP_ZOOM,
+    };
+}
+
+}  // namespace
+
+TEST(mandelbrot_engine, interior_and_exterior) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    MandelJob inside = make_job(MandelAlgorithm::AVX2, 16, 16);
+    inside.viewport  = {.top_left = {-0.2, -0.1}, .scale = 16 / 0.2};
+    for (int v : engine.escape_times(inside)) EXPECT_EQ(v, inside.max_iters);
+
+    MandelJob outside = inside;
+    outside.viewport  = {.top_left = {2.5, 2.5}, .scale = 16};
+    for (int v : engine.escape_times(outside)) EXPECT_LE(v, 2);
+}
+
+TEST(mandelbrot_engine, algorithms_agree) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    auto reference = engine.escape_times(make_job(MandelAlgorithm::OPTIMIZED));
+    ASSERT_EQ(reference.size(), 67u * 45u);
+
+    for (auto alg : {MandelAlgorithm::AVX2, MandelAlgorithm::AVX512,
+                     MandelAlgorithm::DEFAULT}) {
+        auto iters = engine.escape_times(make_job(alg));
+        ASSERT_EQ(iters.size(), reference.size());
+        // Rounding differs slightly between kernels near the boundary
+        EXPECT_LT(count_differences(iters, reference), int(iters.size() / 100))
+            << "algorithm " << static_cast<int>(alg);
+    }
+}
+
+TEST(mandelbrot_engine, float_kernels_match_double) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    for (auto alg : {MandelAlgorithm::AVX2, MandelAlgorithm::AVX512}) {
+        MandelJob job = make_job(alg, 300, 211, 500);
+        job.precision = KernelPrecision::DOUBLE;
+        auto const exact = engine.escape_times(job);
+        job.precision    = KernelPrecision::SINGLE;
+        auto const fast  = engine.escape_times(job);
+        ASSERT_EQ(fast.size(), exact.size());
+        int off = 0;
+        for (size_t i = 0; i < fast.size(); ++i) off += std::abs(fast[i] - exact[i]) > 2;
+        EXPECT_LT(off, int(fast.size() / 100)) << "algorithm " << static_cast<int>(alg);
+    }
+
+    MandelJob job = make_job(MandelAlgorithm::AVX2);
+    EXPECT_TRUE(MandelbrotEngine::single_precision(job));
+    job.viewport.scale = 1e7;
+    EXPECT_FALSE(MandelbrotEngine::single_precision(job));
+    job.precision = KernelPrecision::SINGLE;
+    EXPECT_TRUE(MandelbrotEngine::single_precision(job));
+    job.algorithm = MandelAlgorithm::OPTIMIZED;
+    EXPECT_FALSE(MandelbrotEngine::single_precision(job));
+}
+
+TEST(mandelbrot_engine, double_double_matches_arbitrary_precision) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    constexpr int size = 16;
+    MandelJob job = make_deep_job("-0.743643887037158704752191506114774",
+                                  "0.131825904205311970493132056385139",
+                                  1e18, size, 10000);
+    job.algorithm = MandelAlgorithm::AVX2;
+    EXPECT_EQ(MandelbrotEngine::kernel_name(job), "AVX2 double-double");
+    auto const iters = engine.escape_times(job);
+
+    // As for perturbation, chaotic pixels may differ by a few iterations
+    int differences = 0;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            auto c = job.viewport.precise_screen_to_world({x, y});
+            differences += std::abs(iters[y * size + x]
+                                    - precise_iters_for(c, job.max_iters)) > 2;
+        }
+    }
+    EXPECT_LT(differences, size * size / 50);
+
+    // The same digits at every level: without FMA, SSE2 splits the factors
+    // to get the exact product errors
+    auto dd = [](mpf_class const& v) {
+        return DoubleDouble{v.get_d(), 0} + mpf_class(v - v.get_d(), v.get_prec()).get_d();
+    };
+    for (auto level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > detected_simd_level()) continue;
+        std::vector<int> line(size);
+        for (int y = 0; y < size; ++y) {
+            auto const c = job.viewport.precise_screen_to_world({0, y});
+            dd_line_kernel_for(level)(line.data(), dd(c.x), job.viewport.pixel_size(),
+                                      dd(c.y), size, job.max_iters);
+            EXPECT_TRUE(std::equal(line.begin(), line.end(), iters.begin() + y * size))
+                << simd_level_name(level) << " line " << y;
+        }
+    }
+
+    job.viewport.scale = 1e12;
+    EXPECT_EQ(MandelbrotEngine::kernel_precision(job), KernelPrecision::DOUBLE);
+}
+
+TEST(mandelbrot_engine, perturbation_past_double_double) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    // The limit is a spacing of 2^-99 here, at a scale of about 6.3e29
+    constexpr int size = 8;
+    auto job_at = [](double scale) {
+        MandelJob job = make_deep_job("-0.743643887037158704752191506114774",
+                                      "0.131825904205311970493132056385139",
+                                      scale, size, 10000);
+        job.algorithm = MandelAlgorithm::AVX2;
+        return job;
+    };
+    EXPECT_EQ(MandelbrotEngine::kernel_name(job_at(6e29)), "AVX2 double-double");
+
+    MandelJob job = job_at(7e29);
+    EXPECT_EQ(MandelbrotEngine::kernel_name(job), "perturbation");
+    auto const iters = engine.escape_times(job);
+    int differences  = 0;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            auto c = job.viewport.precise_screen_to_world({x, y});
+            differences += std::abs(iters[y * size + x]
+                                    - precise_iters_for(c, job.max_iters)) > 2;
+        }
+    }
+    EXPECT_LE(differences, 1);
+
+    // Forcing double-double there falls back to perturbation the same way
+    MandelJob forced = job;
+    forced.precision = KernelPrecision::DOUBLE_DOUBLE;
+    EXPECT_EQ(MandelbrotEngine::kernel_name(forced), "perturbation");
+    EXPECT_EQ(engine.escape_times(forced), iters);
+}
+
+TEST(mandelbrot_engine, interior_shortcuts_match_plain_iteration) {
+    ThreadPool tpool(2);
+    MandelbrotEngine engine(tpool);
+
+    // Mostly interior views: the main cardioid and period-2 bulb, which the
+    // bulb test fills, a period-3 bulb only cycle detection finds, and the
+    // cardioid's cusp, whose exterior escapes slowest. Dyadic corners and
+    // scales keep every pixel's coordinates exact whichever strip or line
+    // computes it.
+    struct View {
+        vec2 top_left;
+        double scale;
+        int max_iters;
+    };
+    View const views[] = {
+        {{-0.75, -0.5}, 64, 1000},
+        {{-1.25, -0.25}, 128, 1000},
+        {{-0.25, 0.625}, 256, 1000},
+        {{0.25 - 0x1p-15, -0x1p-15}, 0x1p20, 5000},
+    };
+    constexpr int size = 48;
+    for (View const& v : views) {
+        MandelJob job{.viewport  = {.top_left = v.top_left, .scale = v.scale},
+                      .width     = size,
+                      .height    = size,
+                      .max_iters = v.max_iters,
+                      .algorithm = MandelAlgorithm::OPTIMIZED};
+        double const step = job.viewport.pixel_size();
+        auto plain        = [&](bool fused) {
+            std::vector<int> res(size * size);
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    res[y * size + x] = plain_iters_for(v.top_left.x() + step * x,
+                                                        v.top_left.y() + step * y,
+                                                        v.max_iters, fused);
+                }
+            }
+            return res;
+        };
+        auto const fused = plain(true);
+
+        // Exterior pixels beside interior ones, where a shortcut taken
+        // wrongly would show
+        int interior = 0, edge = 0;
+        for (int y = 1; y + 1 < size; ++y) {
+            for (int x = 1; x + 1 < size; ++x) {
+                int const i = y * size + x;
+                interior += fused[i] == v.max_iters;
+                edge += fused[i] < v.max_iters
+                        && (fused[i - 1] == v.max_iters || fused[i + 1] == v.max_iters
+                            || fused[i - size] == v.max_iters
+                            || fused[i + size] == v.max_iters);
+            }
+        }
+        EXPECT_GT(interior, size * size / 3) << v.top_left.x();
+        EXPECT_GT(edge, 0) << v.top_left.x();
+
+        EXPECT_EQ(count_differences(engine.escape_times(job), fused), 0)
+            << "scalar at " << v.top_left.x();
+
+        auto const separate = plain(false);
+        std::vector<int> line(size);
+        for (auto level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+            if (level > detected_simd_level()) continue;
+            auto const& expected = level == SimdLevel::SSE2 ? separate : fused;
+            int differences      = 0;
+            for (int y = 0; y < size; ++y) {
+                line_kernel_for(level, false)(line.data(), v.top_left.x(),
+                                              v.top_left.x() + step * size,
+                                              v.top_left.y() + step * y, size,
+                                              v.max_iters, {});
+                differences += count_differences(
+                    line, std::span(expected).subspan(y * size, size));
+            }
+            EXPECT_EQ(differences, 0) << simd_level_name(level) << " at " << v.top_left.x();
+        }
+    }
+}
+
+TEST(mandelbrot_engine, line_kernels_refill_lanes_in_any_order) {
+    // Lines shorter than a vector, widths off the two groups of lanes, and
+    // lanes finishing thousands of iterations apart: next to the cusp the
+    // first pixel escapes after about 5000 iterations and its neighbours
+    // after a few dozen, so the other lanes refill many times around it.
+    // The others mix escape times of a hundred to a thousand with interior
+    // pixels.
+    struct Line {
+        double x1, step, y;
+        int max_iters;
+    };
+    Line const lines[] = {
+        {0.25 + 4e-7, 1e-3, 0, 8000},
+        {-0.7475, 1e-4, 0.1, 8000},
+        {-1.2565, 1e-4, 0.3816, 8000},
+    };
+    int const widths[] = {1, 2, 3, 5, 7, 9, 15, 17, 31, 33, 47, 100};
+    for (Line const& ln : lines) {
+        for (int w : widths) {
+            for (bool single : {false, true}) {
+                for (auto level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+                    if (level > detected_simd_level()) continue;
+                    bool const fused = level != SimdLevel::SSE2;
+                    std::vector<int> line(w), expected(w);
+                    double const x2 = ln.x1 + ln.step * w;
+                    line_kernel_for(level, single)(line.data(), ln.x1, x2, ln.y, w,
+                                                   ln.max_iters, {});
+                    double const step = (x2 - ln.x1) / w;
+                    for (int i = 0; i < w; ++i) {
+                        double const cx = ln.x1 + step * i;
+                        expected[i] =
+                            single ? plain_iters_for(float(cx), float(ln.y), ln.max_iters, fused)
+                                   : plain_iters_for(cx, ln.y, ln.max_iters, fused);
+                    }
+                    EXPECT_EQ(line, expected)
+                        << simd_level_name(level) << (single ? " float" : " double")
+                        << ", " << w << " pixels from " << ln.x1;
+                }
+            }
+        }
+    }
+}
+
+TEST(mandelbrot_engine, simd_levels_agree) {
+    int const w = 300, h = 211, mx = 500;
+    MandelJob const job = make_job(MandelAlgorithm::AVX2, w, h, mx);
+    auto render = [&](line_kernel* kernel) {
+        std::vector<int> res(w * h);
+        for (int y = 0; y < h; ++y) {
+            vec2 const l = job.viewport.screen_to_world({0, y});
+            vec2 const r = job.viewport.screen_to_world({w, y});
+            kernel(res.data() + y * w, l.x(), r.x(), l.y(), w, mx, {});
+        }
+        return res;
+    };
+
+    for (bool single : {false, true}) {
+        auto const reference = render(line_kernel_for(SimdLevel::SSE2, single));
+        for (auto level : {SimdLevel::AVX2, SimdLevel::AVX512}) {
+            if (level > detected_simd_level()) continue;
+            auto const iters = render(line_kernel_for(level, single));
+            // Only the FMA changes rounding
+            EXPECT_LT(count_differences(iters, reference), int(iters.size() / 100))
+                << simd_level_name(level) << (single ? " float" : " double");
+        }
+    }
+}
+
+TEST(mandelbrot_engine, channels_in_one_pass) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    MandelJob job    = make_job(MandelAlgorithm::AVX2, 120, 90, 300);
+    job.precision    = KernelPrecision::DOUBLE;
+    vec2 const point = {-0.5, 0.25};
+    auto const ch    = engine.escape_channels(
+        job, {.smooth = true, .trap = OrbitTrap{.point = point}});
+    auto const iters = engine.escape_times(job);
+    ASSERT_EQ(ch.smooth.size(), iters.size());
+    ASSERT_EQ(ch.trap.size(), iters.size());
+    EXPECT_LT(count_differences(ch.iters, iters), int(iters.size() / 100));
+
+    for (int i = 0; i < job.width * job.height; i += 7) {
+        int const n = ch.iters[i];
+        if (n == job.max_iters) {
+            EXPECT_EQ(ch.smooth[i], n);
+        } else {
+            // Orbits that escape slowly, near the tip at c = -2, end well above n
+            EXPECT_GE(ch.smooth[i], n - 1) << i;
+        }
+
+        // Closest approach of the orbit up to where the kernel stopped
+        vec2 const c = job.viewport.screen_to_world({i % job.width, i / job.width});
+        std::complex<double> z = 0;
+        double best            = std::numeric_limits<double>::infinity();
+        for (int k = 0; k < n; ++k) {
+            z    = z * z + std::complex(c.x(), c.y());
+            best = std::min(best, std::abs(z - std::complex(point.x(), point.y())));
+        }
+        // Periodic orbits stop early, which can only raise their minimum
+        if (n < job.max_iters) EXPECT_NEAR(ch.trap[i], best, 1e-4) << i;
+        else EXPECT_GE(ch.trap[i], best - 1e-4) << i;
+    }
+
+    // No bands: away from the set, where the count steps by one the
+    // smooth time barely moves
+    MandelJob outside = job;
+    outside.viewport  = {.top_left = {0.5, 0.5}, .scale = 100};
+    auto const far    = engine.escape_channels(outside, {.smooth = true});
+    int steps         = 0;
+    for (int i = 0; i + 1 < outside.width * outside.height; ++i) {
+        if ((i + 1) % outside.width == 0 || far.iters[i] == far.iters[i + 1]) continue;
+        ++steps;
+        EXPECT_LT(std::abs(far.smooth[i] - far.smooth[i + 1]), 0.2f) << i;
+    }
+    EXPECT_GT(steps, 0);
+
+    EXPECT_THROW(engine.escape_channels(make_job(MandelAlgorithm::OPTIMIZED),
+                                        {.smooth = true}),
+                 std::invalid_argument);
+}
+
+TEST(mandelbrot_engine, small_images) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+    for (auto alg : {MandelAlgorithm::OPTIMIZED, MandelAlgorithm::AVX2}) {
+        auto iters = engine.escape_times(make_job(alg, 3, 2));
+        EXPECT_EQ(iters.size(), 6u);
+    }
+}
+
+TEST(mandelbrot_engine, subdivision_matches_full_render) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    for (auto [w, h] : {std::pair{67, 45}, std::pair{300, 211}}) {
+        MandelJob job = make_job(MandelAlgorithm::AVX2, w, h, 500);
+        auto full     = engine.escape_times(job);
+        job.subdivide = true;
+        auto sub      = engine.escape_times(job);
+        ASSERT_EQ(sub.size(), full.size());
+        EXPECT_LT(count_differences(sub, full), int(full.size() / 100));
+    }
+}
+
+TEST(mandelbrot_engine, pan_reuses_previous_frame) {
+    ThreadPool tpool(4);
+    MandelbrotEngine panned(tpool);
+
+    MandelJob job = make_job(MandelAlgorithm::AVX2, 120, 90, 300);
+    panned.escape_times(job);
+    for (vec2 d : {vec2{7, -5}, vec2{-30, 0}, vec2{0, 0}, vec2{0, 89}}) {
+        job.viewport = job.viewport.shifted(d);
+        auto reused  = panned.escape_times(job);
+        auto fresh   = MandelbrotEngine(tpool).escape_times(job);
+        ASSERT_EQ(reused.size(), fresh.size());
+        EXPECT_LT(count_differences(reused, fresh), int(fresh.size() / 100));
+    }
+}
+
+TEST(frame_reuse, pixel_shift) {
+    Viewport const a{.top_left = {-2, -1}, .scale = 100};
+    auto s = pixel_shift(a, a.shifted({3, -4}), 50, 50);
+    ASSERT_TRUE(s);
+    EXPECT_EQ(*s, vec2i(3, -4));
+
+    EXPECT_FALSE(pixel_shift(a, a.shifted({0.5, 0}), 50, 50));
+    EXPECT_FALSE(pixel_shift(a, a.shifted({50, 0}), 50, 50));
+    Viewport zoomed = a;
+    zoomed.scale    = 101;
+    EXPECT_FALSE(pixel_shift(a, zoomed, 50, 50));
+
+    // Beyond double precision the shift comes from the precise corner
+    Viewport const deep{.top_left         = {-0.75, 0.1},
+                        .scale            = 1e30,
+                        .precise_top_left = PrecisePoint({-0.75, 0.1}, 200)};
+    s = pixel_shift(deep, deep.shifted({2, 1}), 50, 50);
+    ASSERT_TRUE(s);
+    EXPECT_EQ(*s, vec2i(2, 1));
+}
+
+TEST(buffer_pool, reuses_smallest_fitting_buffer) {
+    BufferPool<int> pool;
+    FrameBuffer<int> big = pool.take(1000), small = pool.take(100);
+    int const* const big_data   = big.data();
+    int const* const small_data = small.data();
+    small[5] = 42;
+    pool.give(std::move(big));
+    pool.give(std::move(small));
+
+    auto again = pool.take(80);
+    EXPECT_EQ(again.data(), small_data);
+    EXPECT_EQ(again[5], 42) << "shrinking must not rewrite the buffer";
+    EXPECT_EQ(pool.take(500).data(), big_data);
+    EXPECT_EQ(pool.size(), 0u);
+
+    for (int i = 1; i <= 10; ++i) pool.give(FrameBuffer<int>(i));
+    EXPECT_EQ(pool.size(), BufferPool<int>::max_free);
+    EXPECT_EQ(pool.take(1).capacity(), 3u) << "the smallest buffers go first";
+}
+
+TEST(mandelbrot_engine, recycled_buffers_give_the_same_frames) {
+    ThreadPool tpool(2);
+    MandelbrotEngine engine(tpool);
+    for (auto alg : {MandelAlgorithm::DEFAULT, MandelAlgorithm::OPTIMIZED,
+                     MandelAlgorithm::AVX2}) {
+        MandelJob job = make_job(alg, 80, 60, 300);
+        for (int zoom = 0; zoom < 4; ++zoom) {
+            job.viewport.scale *= 1.5;
+            auto iters = engine.escape_times(job);
+            EXPECT_EQ(iters, MandelbrotEngine(tpool).escape_times(job)) << zoom;
+            engine.recycle(std::move(iters));
+        }
+    }
+}
+
+TEST(thread_pool, parallel_for_covers_each_index_once) {
+    ThreadPool tpool(4);
+    for (int n : {1, 2, 7, 100, 10000}) {
+        for (int grain : {1, 3, 64}) {
+            std::vector<std::atomic_int> hits(n);
+            tpool.parallel_for(0, n, [&](int i1, int i2) {
+                EXPECT_TRUE(i2 - i1 >= grain || i2 == n);
+                for (int i = i1; i < i2; ++i) ++hits[i];
+            }, grain);
+            for (int i = 0; i < n; ++i) ASSERT_EQ(hits[i], 1) << n << " " << i;
+        }
+    }
+
+    // Nested inside workers, which push their helpers on their own deques
+    std::vector<std::atomic_int> hits(64 * 64);
+    tpool.parallel_for(0, 64, [&](int r1, int r2) {
+        for (int r = r1; r < r2; ++r) {
+            tpool.parallel_for(0, 64, [&](int c1, int c2) {
+                for (int c = c1; c < c2; ++c) ++hits[r * 64 + c];
+            });
+        }
+    });
+    EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 64 * 64);
+
+    std::vector<std::atomic_int> area(13 * 9);
+    tpool.parallel_for_2d(13, 9, 4, 2, [&](int x1, int y1, int x2, int y2) {
+        for (int y = y1; y < y2; ++y)
+            for (int x = x1; x < x2; ++x) ++area[y * 13 + x];
+    });
+    EXPECT_EQ(std::count(area.begin(), area.end(), 1), 13 * 9);
+
+    EXPECT_EQ(tpool.queue([](int a) { return 2 * a; }, 21).get(), 42);
+}
+
+TEST(thread_pool, parallel_for_rethrows) {
+    ThreadPool tpool(3);
+    std::atomic_int done = 0;
+    EXPECT_THROW(tpool.parallel_for(0, 1000, [&](int i1, int i2) {
+        for (int i = i1; i < i2; ++i) {
+            if (i == 500) throw std::runtime_error("stop");
+            ++done;
+        }
+    }), std::runtime_error);
+    EXPECT_LT(done, 1000);
+
+    // Still usable afterwards
+    std::atomic_int sum = 0;
+    tpool.parallel_for(0, 100, [&](int i1, int i2) { sum += i2 - i1; });
+    EXPECT_EQ(sum, 100);
+}
+
+TEST(thread_pool, nested_parallel_for_queueing_tasks) {
+    // The worker takes the second outer piece while the first waits for it,
+    // and its nested pieces queue tasks above the nested helper
+    ThreadPool tpool(1);
+    std::atomic_bool second_started = false;
+    std::atomic_int ran             = 0;
+    std::mutex mtx;
+    std::vector<std::future<void>> tasks;
+    tpool.parallel_for(0, 2, [&](int i1, int) {
+        if (i1 == 0) {
+            while (!second_started) std::this_thread::yield();
+            return;
+        }
+        second_started = true;
+        tpool.parallel_for(0, 2, [&](int, int) {
+            auto f = tpool.queue([&] { ++ran; });
+            std::lock_guard g(mtx);
+            tasks.push_back(std::move(f));
+        });
+    });
+    for (auto& f : tasks) f.get();
+    EXPECT_EQ(ran, 2);
+}
+
+TEST(thread_pool, pinned_and_shared_pools) {
+    auto const& topo = cpu_topology();
+    ASSERT_GE(topo.cpu_count(), 1);
+    for (int cpu : topo.nodes.front()) EXPECT_EQ(topo.node_of(cpu), 0);
+
+    ThreadPool pinned({.threads = 3, .pin = true});
+    std::atomic_int sum = 0;
+    pinned.parallel_for(0, 1000, [&](int i1, int i2) { sum += i2 - i1; });
+    EXPECT_EQ(sum, 1000);
+
+    EXPECT_EQ(&ThreadPool::shared(), &ThreadPool::shared());
+    EXPECT_THROW(ThreadPool::configure_shared({}), std::logic_error);
+
+#ifdef __linux__
+    // New frame buffers are never written by the thread allocating them:
+    // their pages fault in on the worker filling them, on its node
+    std::size_t const n  = 1 << 22;
+    long const pages     = long(n * sizeof(int) / sysconf(_SC_PAGESIZE));
+    long const before    = minor_faults();
+    auto buf             = untouched_buffer<int>(n);
+    BufferPool<int> pool;
+    auto missed          = pool.take(n);
+    long const allocated = minor_faults() - before;
+    EXPECT_LT(allocated, pages / 16);
+
+    auto fill = [](FrameBuffer<int>& b) {
+        long const start = minor_faults();
+        std::fill(b.begin(), b.end(), 1);
+        return minor_faults() - start;
+    };
+    EXPECT_GE(pinned.queue(fill, std::ref(buf)).get(), pages / 2);
+    EXPECT_GE(pinned.queue(fill, std::ref(missed)).get(), pages / 2);
+#endif
+}
+
+TEST(thread_pool, priorities_and_deadlines) {
+    using namespace std::chrono_literals;
+    ThreadPool tpool(1);
+    std::promise<void> release;
+    auto blocker = tpool.queue([f = release.get_future().share()] { f.wait(); });
+
+    // Queued behind the blocker, so run strictly by priority
+    std::mutex mtx;
+    std::vector<char> order;
+    auto log = [&](char c) {
+        std::lock_guard g(mtx);
+        order.push_back(c);
+    };
+    auto bg  = tpool.queue({.priority = TaskPriority::BACKGROUND}, log, 'b');
+    auto vis = tpool.queue({.priority = TaskPriority::VISIBLE}, log, 'v');
+    auto ui  = tpool.queue({.priority = TaskPriority::INTERACTIVE}, log, 'i');
+    auto late = tpool.queue({.deadline = std::chrono::steady_clock::now() + 1ms}, log, 'x');
+    std::this_thread::sleep_for(5ms);
+    release.set_value();
+
+    bg.get();
+    EXPECT_EQ(order, (std::vector{'i', 'v', 'b'}));
+    EXPECT_THROW(late.get(), task_expired);
+
+    // Interactive work gets in between the pieces of a background loop
+    ThreadPool::PriorityScope background(TaskPriority::BACKGROUND);
+    std::atomic_int done = 0, done_before = -1;
+    std::future<void> interrupt;
+    tpool.parallel_for(0, 200, [&](int i1, int i2) {
+        if (i1 == 0) {
+            interrupt = tpool.queue({.priority = TaskPriority::INTERACTIVE},
+                                    [&] { done_before = done.load(); });
+        }
+        std::this_thread::sleep_for((i2 - i1) * 100us);
+        done += i2 - i1;
+    });
+    interrupt.get();
+    EXPECT_GE(done_before, 0);
+    EXPECT_LT(done_before, 200);
+}
+
+TEST(trace, summarize_nested_phases_and_busy_threads) {
+    std::vector<trace::Event> const events = {
+        {"compute", trace::phase, 0, 10'000'000, 0, {}},
+        {"colorize", trace::phase, 2'000'000, 3'000'000, 0, {}},  // within compute
+        {"piece", trace::work, 0, 10'000'000, 1, {}},
+        {"piece", trace::work, 0, 4'000'000, 2, {}},
+        {"task", trace::work, 1'000'000, 5'000'000, 2, {}},  // overlaps the piece
+    };
+    auto const stats = trace::summarize(events, 0, 10'000'000, 2);
+    ASSERT_EQ(stats.phase_ms.size(), 2u);
+    EXPECT_STREQ(stats.phase_ms[0].first, "compute");
+    EXPECT_DOUBLE_EQ(stats.phase_ms[0].second, 7);
+    EXPECT_DOUBLE_EQ(stats.phase_ms[1].second, 3);
+    EXPECT_DOUBLE_EQ(stats.utilization, 0.8);  // (10 + 6) / (2 * 10)
+
+    if constexpr (trace::enabled) {
+        std::int64_t const t0 = trace::now_ns();
+        ThreadPool tpool(2);
+        MandelbrotEngine(tpool).escape_times(make_job(MandelAlgorithm::AVX2, 200, 150));
+        auto const recorded = trace::events_since(t0);
+        EXPECT_TRUE(std::any_of(recorded.begin(), recorded.end(), [](auto const& ev) {
+            return std::string_view(ev.name) == "rows" && ev.args[1].second > 0;
+        }));
+        std::ostringstream json;
+        trace::write_chrome_trace(json);
+        EXPECT_NE(json.str().find("\"ph\":\"X\""), std::string::npos);
+    }
+}
+
+TEST(animation, keyframes_zoom_steadily_onto_the_target) {
+    std::istringstream text("# a zoom into the seahorse valley\n"
+                            "0 -0.5 0 100 100\n"
+                            "\n"
+                            "10 -0.75 0.1 100000 1100\n");
+    auto const keys  = parse_keyframes(text);
+    auto const views = interpolate_keyframes(keys);
+    ASSERT_EQ(views.size(), 11u);
+    EXPECT_NEAR((views[10].center.to_vec2() - vec2(-0.75, 0.1)).norm(), 0, 1e-15);
+    EXPECT_NEAR(views[5].scale, std::sqrt(100 * 100000.0), 1e-6);
+    EXPECT_EQ(views[5].max_iters, 600);
+
+    // The target's distance from the middle of the screen, in pixels,
+    // shrinks linearly
+    vec2 const target = keys[1].center.to_vec2();
+    double const start = (target - keys[0].center.to_vec2()).norm() * keys[0].scale;
+    for (int f = 1; f < 10; ++f) {
+        double const px = (target - views[f].center.to_vec2()).norm() * views[f].scale;
+        EXPECT_NEAR(px, start * (10 - f) / 10, 1e-6 * start);
+    }
+
+    std::istringstream backwards("0 0 0 1 1\n5 0 0 1 1\n3 0 0 1 1\n");
+    EXPECT_THROW(parse_keyframes(backwards), std::invalid_argument);
+}
+
+TEST(animation, frames_stream_in_order) {
+    std::vector<FrameView> views;
+    for (int f = 0; f < 5; ++f) views.push_back({PrecisePoint({-0.5, 0}, 64), 10.0 + f, 50});
+
+    ThreadPool tpool(2);
+    std::ostringstream out;
+    Y4mStream sink(out, 32, 16, 25);
+    auto make_job = [](Viewport const& v, int mx) {
+        return MandelJob{.viewport = v, .width = 32, .height = 16, .max_iters = mx};
+    };
+    render_animation<MandelbrotEngine>(tpool, views, 32, 16, make_job, sink, 3);
+
+    std::string const header = "YUV4MPEG2 W32 H16 F25:1 Ip A1:1 C420jpeg\n";
+    std::size_t const frame  = 6 + 32 * 16 * 3 / 2;
+    ASSERT_EQ(out.str().size(), header.size() + 5 * frame);
+    EXPECT_EQ(out.str().substr(0, header.size()), header);
+
+    // Frame 3 alone comes out the same
+    std::ostringstream single;
+    Y4mStream one(single, 32, 16, 25);
+    render_animation<MandelbrotEngine>(tpool, std::span(views).subspan(3, 1), 32, 16,
+                                       make_job, one, 3);
+    EXPECT_EQ(out.str().substr(header.size() + 3 * frame, frame),
+              single.str().substr(header.size()));
+}
+
+TEST(tiled_export, resumes_where_it_stopped) {
+    auto const path = (std::filesystem::temp_directory_path() / "tiled_export_test.tif").string();
+    auto tile_pixels = [](int i) { return std::vector<std::uint8_t>(3 * 16 * 16, 10 + i); };
+    {
+        TiledExport out(path, 40, 20, 16, "test");
+        ASSERT_EQ(out.tile_count(), 6);
+        EXPECT_FALSE(out.resumed());
+        for (int i = 0; i < 4; ++i) out.write_tile(i, tile_pixels(i));
+    }  // interrupted
+    {
+        TiledExport other(path, 40, 20, 16, "other");
+        EXPECT_FALSE(other.resumed());
+        EXPECT_EQ(other.done_count(), 0);
+        for (int i = 0; i < 4; ++i) other.write_tile(i, tile_pixels(i));
+    }
+    TiledExport out(path, 40, 20, 16, "other");
+    ASSERT_TRUE(out.resumed());
+    EXPECT_TRUE(out.done(3));
+    EXPECT_FALSE(out.done(4));
+    EXPECT_EQ(out.tile_x(4), 16);
+    EXPECT_EQ(out.tile_y(4), 16);
+    for (int i = 4; i < 6; ++i) out.write_tile(i, tile_pixels(i));
+    out.finish();
+    EXPECT_FALSE(std::filesystem::exists(path + ".progress"));
+
+    // Tile 5 where the BigTIFF's tile offsets say it is
+    std::ifstream in(path, std::ios::binary);
+    std::string const file((std::istreambuf_iterator<char>(in)), {});
+    ASSERT_EQ(file.substr(0, 4), std::string("II+\0", 4));
+    auto u64 = [&](std::size_t at) {
+        std::uint64_t v = 0;
+        for (int k = 7; k >= 0; --k) v = v << 8 | std::uint8_t(file[at + k]);
+        return v;
+    };
+    std::size_t const ifd = u64(8);
+    std::size_t const tile_offsets = u64(ifd + 8 + 9 * 20 + 12);  // tenth entry
+    std::size_t const tile5        = u64(tile_offsets + 5 * 8);
+    ASSERT_LT(tile5, file.size());
+    EXPECT_EQ(std::uint8_t(file[tile5]), 15);
+    std::filesystem::remove(path);
+}
+
+TEST(partition, chunks_balance_cost_heaviest_first) {
+    // A few rows cost a hundred times the rest, like a band across the set
+    std::vector<double> costs(500, 1.0);
+    std::fill(costs.begin() + 200, costs.begin() + 230, 100.0);
+    double const total = std::accumulate(costs.begin(), costs.end(), 0.0);
+
+    auto const chunks = cost_balanced_chunks(costs, 16);
+    ASSERT_EQ(chunks.size(), 16u);
+    std::vector<int> covered(costs.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        RowChunk const& c = chunks[i];
+        for (int y = c.begin; y < c.end; ++y) ++covered[y];
+        EXPECT_NEAR(c.cost, std::accumulate(&costs[c.begin], &costs[c.end], 0.0), 1e-9);
+        EXPECT_LT(c.cost, 2 * total / 16) << c.begin << "-" << c.end;
+        if (i > 0) {
+            EXPECT_GE(chunks[i - 1].cost, c.cost);
+        }
+    }
+    EXPECT_EQ(std::count(covered.begin(), covered.end(), 1), int(costs.size()));
+
+    auto const even = cost_balanced_chunks(std::vector<double>(10, 0.0), 4);
+    ASSERT_EQ(even.size(), 4u);
+    EXPECT_EQ(even[0].begin, 0);
+    EXPECT_EQ(even[3].end, 10);
+    EXPECT_EQ(cost_balanced_chunks(std::vector<double>(3, 1.0), 64).size(), 3u);
+}
+
+TEST(mandelbrot_engine, colorize_respects_rowstride) {
+    ThreadPool tpool(2);
+    MandelbrotEngine engine(tpool);
+    MandelJob job = make_job(MandelAlgorithm::BLACK_AND_WHITE, 5, 3);
+
+    int const stride = 3 * job.width + 1;
+    std::vector<std::uint8_t> data(stride * job.height, 42);
+    engine.render(job, data.data(), stride);
+    for (int y = 0; y < job.height; ++y) {
+        EXPECT_EQ(data[y * stride + stride - 1], 42) << "padding overwritten";
+    }
+}
+
+TEST(mandelbrot_engine, antialias_resamples_only_edges) {
+    ThreadPool tpool(2);
+    MandelbrotEngine engine(tpool);
+    MandelJob job = make_job(MandelAlgorithm::DEFAULT, 60, 40);
+    int const n   = job.width * job.height;
+
+    // Reference: 4 x 4 times the pixels, box filtered
+    MandelJob fine      = make_job(MandelAlgorithm::DEFAULT, 4 * job.width, 4 * job.height);
+    fine.viewport.scale = 4 * job.viewport.scale;
+    std::vector<std::uint8_t> big(3 * 16 * n);
+    engine.render(fine, big.data(), 3 * fine.width);
+    std::vector<double> reference(3 * n);
+    for (int y = 0; y < fine.height; ++y) {
+        for (int x = 0; x < fine.width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                reference[3 * (y / 4 * job.width + x / 4) + c] +=
+                    big[3 * (y * fine.width + x) + c] / 16.0;
+            }
+        }
+    }
+    auto error = [&](std::vector<std::uint8_t> const& img) {
+        double sum = 0;
+        for (int i = 0; i < 3 * n; ++i) sum += std::abs(img[i] - reference[i]);
+        return sum / (3 * n);
+    };
+
+    std::vector<std::uint8_t> plain(3 * n);
+    auto const iters = engine.escape_times(job);
+    engine.colorize(job, iters, plain.data(), 3 * job.width);
+    std::vector<std::uint8_t> smooth = plain;
+    job.antialias   = 4;
+    int const count = engine.antialias(job, iters, smooth.data(), 3 * job.width);
+
+    EXPECT_GT(count, 0);
+    EXPECT_LT(count, n / 2);
+    EXPECT_LT(error(smooth), 0.6 * error(plain));
+    job.algorithm = MandelAlgorithm::DEEP_ZOOM;
+    EXPECT_EQ(engine.antialias(job, iters, smooth.data(), 3 * job.width), 0);
+}
+
+TEST(mandelbrot_engine, histogram_antialias_ignores_other_frames) {
+    ThreadPool tpool(2);
+    MandelbrotEngine engine(tpool);
+
+    // Counted and sorted histograms: max_iters below and above the pixels
+    for (int mx : {200, 5000}) {
+        MandelJob job = make_job(MandelAlgorithm::HISTOGRAM, 48, 32, mx);
+        job.antialias = 2;
+        std::vector<std::uint8_t> expected(3 * job.width * job.height);
+        engine.render(job, expected.data(), 3 * job.width);
+
+        auto const iters = engine.escape_times(job);
+        std::vector<std::uint8_t> image(expected.size());
+        engine.colorize(job, iters, image.data(), 3 * job.width);
+
+        // Another frame coloured in between replaces the engine's tables
+        MandelJob other = make_job(MandelAlgorithm::HISTOGRAM, 40, 40, mx / 2);
+        other.viewport  = {.top_left = {-0.2, 0.6}, .scale = 400};
+        auto const other_iters = engine.escape_times(other);
+        std::vector<std::uint8_t> scratch(3 * other.width * other.height);
+        engine.colorize(other, other_iters, scratch.data(), 3 * other.width);
+
+        EXPECT_GT(engine.antialias(job, iters, image.data(), 3 * job.width), 0) << mx;
+        EXPECT_EQ(image, expected) << mx;
+    }
+}
+
+TEST(mandelbrot_engine, antialiased_tiles_join_without_seams) {
+    ThreadPool tpool(2);
+    MandelbrotEngine engine(tpool);
+    // A dyadic corner and scale keep every tile's samples where the whole
+    // image has them
+    MandelJob const job{.viewport  = {.top_left = {-2, -1.25}, .scale = 32},
+                        .width     = 96,
+                        .height    = 64,
+                        .max_iters = 200,
+                        .algorithm = MandelAlgorithm::AVX2,
+                        .antialias = 2};
+    int const w = job.width, h = job.height;
+    std::vector<std::uint8_t> whole(3 * w * h);
+    engine.render(job, whole.data(), 3 * w);
+
+    for (int t : {16, 32}) {
+        std::vector<std::uint8_t> tiled(3 * w * h);
+        for (int y = 0; y < h; y += t) {
+            for (int x = 0; x < w; x += t) {
+                MandelJob tile = job;
+                tile.viewport  = job.viewport.shifted({x, y});
+                tile.width = tile.height = t;
+                engine.render_tile(tile, tiled.data() + 3 * (y * w + x), 3 * w);
+            }
+        }
+        EXPECT_EQ(tiled, whole) << t << " pixel tiles";
+    }
+}
+
+TEST(palette, tables_match_palette) {
+    Palette reference;
+    PaletteLut const lut;
+    for (double h : {0.0, 0.1, 0.16, 0.5, 0.77, 1.0}) {
+        argb32 const c = lut.hue(h);
+        RGB const r    = reference[h];
+        EXPECT_NEAR(c >> 16 & 0xff, r[0], 1.5) << h;
+        EXPECT_NEAR(c >> 8 & 0xff, r[1], 1.5) << h;
+        EXPECT_NEAR(c & 0xff, r[2], 1.5) << h;
+    }
+
+    ThreadPool tpool(2);
+    MandelbrotEngine engine(tpool);
+    MandelJob const job = make_job(MandelAlgorithm::AVX2, 40, 30, 100);
+    auto const iters    = engine.escape_times(job);
+    std::vector<std::uint8_t> rgb(3 * iters.size());
+    engine.colorize(job, iters, rgb.data(), 3 * job.width);
+    for (size_t i = 0; i < iters.size(); ++i) {
+        RGB const c = reference[iters[i] / 100.0];
+        for (int k = 0; k < 3; ++k) {
+            EXPECT_EQ(rgb[3 * i + k], std::uint8_t(c[k])) << i;
+        }
+    }
+}
+
+TEST(palette, histogram_dense_and_sparse) {
+    ThreadPool tpool(3);
+    MandelbrotEngine engine(tpool);
+    PaletteLut const lut;
+    // 100 is below the pixel count, a million far above it
+    for (int mx : {100, 1000000}) {
+        MandelJob const job = make_job(MandelAlgorithm::HISTOGRAM, 40, 30, mx);
+        auto const iters    = engine.escape_times(job);
+        std::map<int, int> below;
+        for (int n : iters) ++below[n];
+        for (int sum = 0; auto& [n, count] : below) count = sum += count;
+
+        std::vector<std::uint8_t> rgb(3 * iters.size());
+        engine.colorize(job, iters, rgb.data(), 3 * job.width);
+        for (size_t i = 0; i < iters.size(); ++i) {
+            argb32 const c = lut.hue(below[iters[i]] / double(iters.size()));
+            EXPECT_EQ(rgb[3 * i], c >> 16 & 0xff) << mx << " " << i;
+            EXPECT_EQ(rgb[3 * i + 1], c >> 8 & 0xff) << mx << " " << i;
+            EXPECT_EQ(rgb[3 * i + 2], c & 0xff) << mx << " " << i;
+        }
+    }
+}
+
+TEST(tile_cache, revisits_hit_the_cache) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    // The corner sits on a whole pixel of the zoom level's grid
+    MandelJob job = make_job(MandelAlgorithm::AVX2, 150, 100, 300);
+    job.viewport  = {.top_left = {-2, -1.28}, .scale = 50};
+    auto const first = engine.escape_times(job);
+
+    MandelJob elsewhere      = job;
+    elsewhere.viewport.scale = 80;
+    engine.escape_times(elsewhere);
+
+    auto const before = engine.tile_cache().stats();
+    EXPECT_EQ(engine.escape_times(job), first);
+    auto const after = engine.tile_cache().stats();
+    EXPECT_EQ(after.misses, before.misses);
+    EXPECT_GT(after.hits, before.hits);
+
+    // A pan off the tile boundaries still assembles from the same tiles
+    engine.escape_times(elsewhere);
+    job.viewport     = job.viewport.shifted({37, -21});
+    auto const moved = engine.escape_times(job);
+    auto const fresh = MandelbrotEngine(tpool).escape_times(job);
+    EXPECT_LT(count_differences(moved, fresh), int(fresh.size() / 100));
+}
+
+TEST(tile_cache, evicts_least_recently_used) {
+    std::vector<int> const tile(TileCache::tile_size * TileCache::tile_size, 7);
+    auto key = [](std::int64_t x) {
+        return TileKey{50, 100, MandelAlgorithm::AVX2, false,
+                       KernelPrecision::DOUBLE, x, 0};
+    };
+
+    TileCache cache;
+    cache.insert(key(0), tile);
+    std::size_t const cost = cache.memory_used();
+    cache.set_budget(2 * cost);
+
+    cache.insert(key(1), tile);
+    ASSERT_TRUE(cache.find(key(0)));
+    cache.insert(key(2), tile);
+    EXPECT_TRUE(cache.find(key(0)));
+    EXPECT_FALSE(cache.find(key(1)));
+    EXPECT_TRUE(cache.find(key(2)));
+    EXPECT_EQ(cache.stats().evictions, 1);
+    EXPECT_LE(cache.memory_used(), 2 * cost);
+
+    EXPECT_FALSE(grid_origin({.top_left = {0.5, 0}, .scale = 3}));
+    EXPECT_EQ(*grid_origin({.top_left = {-2, 0.5}, .scale = 4}),
+              (std::array<std::int64_t, 2>{-8, 2}));
+    EXPECT_EQ(*grid_origin({.top_left         = {-2, 0.5},
+                            .scale            = 4,
+                            .precise_top_left = PrecisePoint({-2, 0.5}, 64)}),
+              (std::array<std::int64_t, 2>{-8, 2}));
+}
+
+TEST(async_render, latest_request_wins) {
+    ThreadPool tpool(4);
+    std::atomic_int updates = 0;
+    AsyncRenderer<MandelbrotEngine, MandelJob> renderer(tpool, [&] { ++updates; });
+
+    // Superseded requests may be cancelled at any point
+    MandelJob job = make_job(MandelAlgorithm::AVX2, 150, 130, 300);
+    for (vec2 d : {vec2{0, 0}, vec2{40, 3}, vec2{-11, 20}}) {
+        job.viewport = job.viewport.shifted(d);
+        renderer.request(job);
+    }
+
+    RenderedFrame last;
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!last.complete || last.viewport.top_left != job.viewport.top_left) {
+        ASSERT_LT(std::chrono::steady_clock::now(), deadline);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        renderer.consume([&](RenderedFrame const& f) { last = f; });
+    }
+    // Preview and one publication per band came before the final frame
+    EXPECT_GE(updates, 1 + 3);
+
+    FrameBuffer<argb32> expected(job.width * job.height);
+    MandelbrotEngine(tpool).render(job, reinterpret_cast<std::uint8_t*>(expected.data()),
+                                   4 * job.width, PixelFormat::ARGB32);
+    ASSERT_EQ(last.width, job.width);
+    ASSERT_EQ(last.height, job.height);
+    EXPECT_EQ(last.pixels, expected);
+
+    // The same colours as the RGB output
+    std::vector<std::uint8_t> rgb(3 * job.width * job.height);
+    MandelbrotEngine(tpool).render(job, rgb.data(), 3 * job.width);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        std::uint8_t px[3];
+        write_rgb(px, expected[i]);
+        ASSERT_TRUE(std::equal(px, px + 3, rgb.begin() + 3 * i)) << i;
+        ASSERT_EQ(expected[i] >> 24, 0xffu) << i;
+    }
+}
+
+TEST(async_render, failed_job_is_reported) {
+    // Fails the jobs with no iterations, renders the others
+    struct FailingEngine : MandelbrotEngine {
+        using MandelbrotEngine::MandelbrotEngine;
+        FrameBuffer<int> escape_times(MandelJob const& job,
+                                      RenderControl<int> const& ctl = {}) {
+            if (job.max_iters == 0) throw std::runtime_error("no iterations");
+            return MandelbrotEngine::escape_times(job, ctl);
+        }
+    };
+    ThreadPool tpool(2);
+    AsyncRenderer<FailingEngine, MandelJob> renderer(tpool, {});
+
+    auto wait_for = [&](auto const& done) {
+        RenderedFrame last;
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (!done(last)) {
+            if (std::chrono::steady_clock::now() > deadline) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            renderer.consume([&](RenderedFrame const& f) { last = f; });
+        }
+        return last;
+    };
+
+    MandelJob job = make_job(MandelAlgorithm::AVX2, 64, 48, 0);
+    renderer.request(job);
+    RenderedFrame failed = wait_for([](RenderedFrame const& f) { return !f.error.empty(); });
+    EXPECT_EQ(failed.error, "no iterations");
+    EXPECT_FALSE(failed.complete);
+
+    // The render thread survives and the next job clears the error
+    job.max_iters = 100;
+    renderer.request(job);
+    RenderedFrame done = wait_for([](RenderedFrame const& f) { return f.complete; });
+    EXPECT_TRUE(done.complete);
+    EXPECT_TRUE(done.error.empty());
+    EXPECT_EQ(done.width, job.width);
+}
+
+TEST(newton_engine, converges_to_roots) {
+    ThreadPool tpool(4);
+    NewtonEngine engine(tpool);
+
+    math::Polynomial p(std::to_array<math::complex>({-1, 0, 0, 1}));
+    NewtonJob job{
+        .viewport   = {.top_left = {-2, -2}, .scale = 8},
+        .width      = 32,
+        .height     = 32,
+        .max_iters  = 50,
+        .polynomial = p,
+        .derivative = math::derivative(p),
+        .roots      = math::find_roots(p, 1e-10),
+    };
+
+    auto pts = engine.escape_times(job);
+    ASSERT_EQ(pts.size(), 32u * 32u);
+
+    // The pixel at world (1, 0) starts on a root
+    auto const& at_one = pts[16 * 32 + 24];
+    ASSERT_GE(at_one.root, 0);
+    EXPECT_TRUE(NewtonEngine::is_near(job.roots[at_one.root], {1, 0}));
+    EXPECT_EQ(at_one.iterations, 0);
+
+    int converged = 0;
+    for (auto const& pt : pts) converged += pt.root != -1;
+    EXPECT_GT(converged, int(pts.size() * 9 / 10));
+}
+
+TEST(perturbation, matches_double_at_shallow_zoom) {
+    ThreadPool tpool(4);
+    MandelbrotEngine engine(tpool);
+
+    auto reference = engine.escape_times(make_job(MandelAlgorithm::OPTIMIZED));
+    auto deep      = engine.escape_times(make_job(MandelAlgorithm::DEEP_ZOOM));
+    ASSERT_EQ(deep.size(), reference.size());
+    EXPECT_LT(count_differences(deep, reference), int(deep.size() / 100));
+}
+
+TEST(perturbation, matches_arbitrary_precision_deep_zoom) {
+    ThreadPool tpool(4);
+    PerturbationEngine engine(tpool);
+
+    constexpr int size = 16;
+    MandelJob job = make_deep_job("-0.743643887037158704752191506114774",
+                                  "0.131825904205311970493132056385139",
+                                  1e18, size, 10000);
+    auto deep = engine.escape_times(job);
+    EXPECT_GT(engine.last_stats().skipped_iters, 0) << "series approximation unused";
+    EXPECT_EQ(engine.last_stats().glitched_pixels, 0);
+
+    // Chaotic pixels right at the boundary may still differ by a few
+    // iterations after thousands of rounding steps
+    int differences = 0;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            auto c = job.viewport.precise_screen_to_world({x, y});
+            differences += std::abs(deep[y * size + x]
+                                    - precise_iters_for(c, job.max_iters)) > 2;
+        }
+    }
+    EXPECT_LT(differences, size * size / 50);
+
+    // Plain doubles cannot tell these pixels apart any more
+    job.algorithm = MandelAlgorithm::AVX2;
+    job.precision = KernelPrecision::DOUBLE;
+    auto flat     = MandelbrotEngine(tpool).escape_times(job);
+    EXPECT_GT(count_differences(flat, deep), size * size / 2);
+}
+
+TEST(perturbation, re_references_glitches) {
+    ThreadPool tpool(4);
+    PerturbationEngine engine(tpool);
+
+    // Centred on a minibrot: the reference stays bounded while the
+    // surrounding pixels lose precision against it
+    constexpr int size = 32;
+    MandelJob job = make_deep_job("-1.768778833", "-0.001738996", 2e9, size, 2000);
+    auto deep = engine.escape_times(job);
+
+    int differences = 0;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            auto c = job.viewport.precise_screen_to_world({x, y});
+            differences += std::abs(deep[y * size + x]
+                                    - precise_iters_for(c, job.max_iters)) > 2;
+        }
+    }
+    EXPECT_LT(differences, size * size / 50);
+    EXPECT_GT(engine.last_stats().references, 1);
+    EXPECT_EQ(engine.last_stats().glitched_pixels, 0);
+}
@@ -0,0 +1,25 @@
+#include <frame_reuse.hpp>
+
+#include <cmath>
+
+vec2 corner_offset(Viewport const& from, Viewport const& to) {
+    if (from.precise_top_left && to.precise_top_left) {
+        // The doubles can no longer resolve a pixel at deep zooms
+        mpf_class const dx = to.precise_top_left->x - from.precise_top_left->x;
+        mpf_class const dy = to.precise_top_left->y - from.precise_top_left->y;
+        return vec2{dx.get_d(), dy.get_d()} * to.scale;
+    }
+    return (to.top_left - from.top_left) * to.scale;
+}
+
+std::optional<vec2i> pixel_shift(Viewport const& from, Viewport const& to,
+                                 int w, int h) {
+    if (from.scale != to.scale) return std::nullopt;
+
+    vec2 const d       = corner_offset(from, to);
+    vec2 const rounded = d.array().round();
+    if ((d - rounded).cwiseAbs().maxCoeff() > 1e-3) return std::nullopt;
+    if (std::abs(rounded.x()) >= w || std::abs(rounded.y()) >= h)
+        return std::nullopt;
+    return rounded.cast<int>();
+}
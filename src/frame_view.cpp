@@ -0,0 +1,70 @@
+#include <frame_view.hpp>
+#include <frame_reuse.hpp>
+#include <threadpool.hpp>
+#include <trace.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+
+void update_surface(FrameSurface& fs, RenderedFrame const& frame) {
+    trace::Span span("present", trace::phase);
+    int y1 = frame.dirty_y1, y2 = frame.dirty_y2;
+    int const w = frame.width;
+    auto& surface = fs.surface;
+    if (!surface || surface->get_width() != w || surface->get_height() != frame.height) {
+        surface.reset();
+        if (w <= 0 || frame.height <= 0) return;
+        // RGB24 rows of whole words need no padding
+        assert(Cairo::ImageSurface::format_stride_for_width(
+                   Cairo::Surface::Format::RGB24, w)
+               == 4 * w);
+        fs.storage.resize(std::size_t(w) * frame.height);
+        surface = Cairo::ImageSurface::create(
+            reinterpret_cast<unsigned char*>(fs.storage.data()),
+            Cairo::Surface::Format::RGB24, w, frame.height, 4 * w);
+        y1 = 0;
+        y2 = frame.height;
+    }
+    if (y1 >= y2) return;
+
+    surface->flush();
+    std::copy(frame.pixels.begin() + std::size_t(y1) * w,
+              frame.pixels.begin() + std::size_t(y2) * w,
+              fs.storage.begin() + std::size_t(y1) * w);
+    surface->mark_dirty(0, y1, w, y2 - y1);
+}
+
+void paint_frame(Cairo::RefPtr<Cairo::Context> const& cr,
+                 FrameSurface const& fs, Viewport const& shown,
+                 Viewport const& current) {
+    trace::Span span("present", trace::phase);
+    cr->save();
+    cr->set_source_rgb(0, 0, 0);
+    cr->paint();
+    if (!fs.surface) {
+        cr->restore();
+        return;
+    }
+
+    vec2 const offset = -corner_offset(shown, current);
+    cr->translate(offset.x(), offset.y());
+    cr->scale(current.scale / shown.scale, current.scale / shown.scale);
+    cr->set_source(fs.surface, 0, 0);
+    cr->paint();
+    cr->restore();
+}
+
+std::string frame_stats_text(std::int64_t started_ns, double render_ms) {
+    if (!trace::enabled) return {};
+    auto const events = trace::events_since(started_ns);
+    auto const stats  = trace::summarize(events, started_ns,
+                                         started_ns + std::int64_t(render_ms * 1e6),
+                                         ThreadPool::shared().size() + 1);
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(1);
+    for (auto const& [name, ms] : stats.phase_ms) os << name << ' ' << ms << " ms\n";
+    os << "threads " << std::setprecision(0) << 100 * stats.utilization << "% busy";
+    return os.str();
+}
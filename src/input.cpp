@@ -1,5 +1,6 @@
 #include <input.hpp>
 
+#include <cmath>
 #include <iostream>
 
 void InputCapture::on_resize(int w, int h) { size = {w, h}; }
@@ -9,21 +10,31 @@ void InputCapture::mouse_move(double x, double y) { mouse_pos = {x, y}; }
 void InputCapture::drag_beg(double, double) { last_pan = {0, 0}; }
 
 void InputCapture::drag(double x, double y) {
-    top_left -= (vec2{x, y} - last_pan) / scale;
-    last_pan = {x, y};
+    // Pan by whole pixels so the renderers can reuse the previous frame
+    vec2 const d = (vec2{x, y} - last_pan).array().round();
+    if (d.isZero()) return;
+    precise_top_left -= d / scale;
+    top_left = precise_top_left.to_vec2();
+    last_pan += d;
     sig_changed();
 }
 
 bool InputCapture::scroll(double, double dy) {
     if (dy == 0) return false;
-    vec2 before = screen_to_world(mouse_pos);
-    if (dy < 0) {
-        scale *= 1 + (dy / -100);
-    } else if (dy > 0) {
-        scale /= 1 + (dy / 100);
-    }
-    vec2 after = screen_to_world(mouse_pos);
-    top_left   += (before - after);
+    double const factor = dy < 0 ? 1 + (dy / -100) : 1 / (1 + (dy / 100));
+    zoom += std::log2(factor) * levels_per_octave;
+
+    double const old_scale = scale;
+    scale = base_scale * std::exp2(std::round(zoom) / levels_per_octave);
+    if (scale == old_scale) return true;
+
+    // Keep the world point under the mouse fixed. Computed as a difference
+    // of offsets so it stays exact when top_left has more digits than a double
+    precise_top_left.set_precision(precision_for_scale(scale));
+    precise_top_left += mouse_pos / old_scale - mouse_pos / scale;
+    // Stay on the pixel grid of the zoom level, as drags do
+    precise_top_left.snap_to_grid(scale);
+    top_left = precise_top_left.to_vec2();
     sig_changed();
     return true;
 }
@@ -76,8 +87,9 @@ InputCapture::InputCapture(Gtk::DrawingArea& frame) {
     mouse_click->set_button(0);
     frame.add_controller(mouse_click);
 
-    scale    = 500 / 4;
-    top_left = {-2, -2};
+    scale            = base_scale;
+    top_left         = {-2, -2};
+    precise_top_left = PrecisePoint(top_left, precision_for_scale(scale));
 
     frame.signal_resize().connect([this](int w, int h) { on_resize(w, h); });
 }
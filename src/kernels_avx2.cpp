@@ -0,0 +1,221 @@
+#include <line_kernel.hpp>
+#include <simd_kernels.hpp>
+
+#include <immintrin.h>
+#include <type_traits>
+
+// Compiled with -mavx2 -mfma; only called when the CPU has both
+
+namespace {
+
+struct Avx2Lanes {
+    using F = double;
+    using I = std::int64_t;
+    __m256d x, y, cx, xs, ys;
+    __m256i n, save_at;
+};
+
+struct Avx2TrapLanes : Avx2Lanes {
+    __m256d trap;
+};
+
+struct Avx2FloatLanes {
+    using F = float;
+    using I = std::int32_t;
+    __m256 x, y, cx, xs, ys;
+    __m256i n, save_at;
+};
+
+struct Avx2FloatTrapLanes : Avx2FloatLanes {
+    __m256 trap;
+};
+
+/// Runs `groups` independent vectors of 4 pixels in one loop so their FMA
+/// chains overlap. A lane whose pixel finished is refilled with the next
+/// pending pixel of the line at once instead of idling until its whole
+/// vector is done. With `channels` each lane also tracks its orbit's
+/// closest approach to the trap, and refill writes the channels `ch` asks
+/// for.
+template<int groups, bool channels>
+void avx2_refill_line(int* const __restrict pline, double const x1,
+                      double const x2, double const y1, int const linew,
+                      int const maxiters, LineChannels const& ch) {
+    LineQueue q{.pline    = pline,
+                .x1       = x1,
+                .step     = (x2 - x1) / linew,
+                .cy       = y1,
+                .linew    = linew,
+                .maxiters = maxiters,
+                .ch       = channels ? &ch : nullptr};
+
+    const __m256d cy       = _mm256_set1_pd(y1);
+    const __m256d escape   = _mm256_set1_pd(4.0);
+    const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+    const __m256d epsilon  = _mm256_set1_pd(period_epsilon);
+    const __m256i one      = _mm256_set1_epi64x(1);
+    const __m256i mx       = _mm256_set1_epi64x(maxiters);
+    // Only read when computing channels
+    TrapForm const& form = ch.trap_form;
+    const __m256d ta     = _mm256_set1_pd(form.a);
+    const __m256d tb     = _mm256_set1_pd(form.b);
+    const __m256d tc     = _mm256_set1_pd(form.c);
+    const __m256d td     = _mm256_set1_pd(form.d);
+    const __m256d te     = _mm256_set1_pd(form.e);
+    const __m256d tf     = _mm256_set1_pd(form.f);
+
+    using State = std::conditional_t<channels, Avx2TrapLanes, Avx2Lanes>;
+    State s[groups];
+    int pixel[groups][4];
+    int alive[groups] = {};
+    for (int g = 0; g < groups; ++g) {
+        for (int l = 0; l < 4; ++l) pixel[g][l] = -1;
+        s[g] = refill(State{}, 0xF, pixel[g], alive[g], q);
+    }
+
+    for (unsigned t = 1; q.live > 0; ++t) {
+        for (int g = 0; g < groups; ++g) {
+            // Emptied groups at the end of the line cost as much as full ones
+            if (groups > 1 && alive[g] == 0) continue;
+            State& l = s[g];
+            __m256d x2   = _mm256_mul_pd(l.x, l.x);
+            __m256d y2   = _mm256_mul_pd(l.y, l.y);
+            __m256d const done =
+                _mm256_or_pd(_mm256_cmp_pd(_mm256_add_pd(x2, y2), escape, _CMP_GT_OQ),
+                             _mm256_castsi256_pd(_mm256_cmpeq_epi64(l.n, mx)));
+            if (int const lanes = _mm256_movemask_pd(done)) {
+                l  = refill(l, lanes, pixel[g], alive[g], q);
+                x2 = _mm256_mul_pd(l.x, l.x);
+                y2 = _mm256_mul_pd(l.y, l.y);
+            }
+
+            l.y = _mm256_fmadd_pd(_mm256_add_pd(l.x, l.x), l.y, cy);
+            l.x = _mm256_add_pd(_mm256_sub_pd(x2, y2), l.cx);
+            l.n = _mm256_add_epi64(l.n, one);
+            if constexpr (channels) {
+                __m256d const u = _mm256_fmadd_pd(ta, l.x, _mm256_fmadd_pd(tb, l.y, tc));
+                __m256d const v = _mm256_fmadd_pd(td, l.x, _mm256_fmadd_pd(te, l.y, tf));
+                l.trap = _mm256_min_pd(_mm256_fmadd_pd(u, u, _mm256_mul_pd(v, v)), l.trap);
+            }
+
+            // Brent's cycle detection every 8th step, saving the point once
+            // the lane's count passes the next power of two. Checking
+            // sparsely still finds every cycle, a little later.
+            if (t % 8 == 0) {
+                __m256d const periodic = _mm256_and_pd(
+                    _mm256_cmp_pd(_mm256_and_pd(_mm256_sub_pd(l.x, l.xs), abs_mask),
+                                  epsilon, _CMP_LT_OQ),
+                    _mm256_cmp_pd(_mm256_and_pd(_mm256_sub_pd(l.y, l.ys), abs_mask),
+                                  epsilon, _CMP_LT_OQ));
+                l.n = _mm256_castpd_si256(_mm256_blendv_pd(
+                    _mm256_castsi256_pd(l.n), _mm256_castsi256_pd(mx), periodic));
+
+                __m256i const save = _mm256_cmpgt_epi64(l.n, l.save_at);
+                l.xs      = _mm256_blendv_pd(l.xs, l.x, _mm256_castsi256_pd(save));
+                l.ys      = _mm256_blendv_pd(l.ys, l.y, _mm256_castsi256_pd(save));
+                l.save_at = _mm256_add_epi64(l.save_at, _mm256_and_si256(l.save_at, save));
+            }
+        }
+    }
+}
+
+/// avx2_refill_line on 8 floats per vector, for views where float still
+/// resolves neighbouring pixels
+template<int groups, bool channels>
+void avx2_refill_line_float(int* const __restrict pline, double const x1,
+                            double const x2, double const y1, int const linew,
+                            int const maxiters, LineChannels const& ch) {
+    LineQueue q{.pline    = pline,
+                .x1       = x1,
+                .step     = (x2 - x1) / linew,
+                .cy       = y1,
+                .linew    = linew,
+                .maxiters = maxiters,
+                .ch       = channels ? &ch : nullptr};
+
+    const __m256 cy       = _mm256_set1_ps(static_cast<float>(y1));
+    const __m256 escape   = _mm256_set1_ps(4.0f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(INT32_MAX));
+    const __m256 epsilon  = _mm256_set1_ps(period_epsilon_float);
+    const __m256i one     = _mm256_set1_epi32(1);
+    const __m256i mx      = _mm256_set1_epi32(maxiters);
+    // Only read when computing channels
+    TrapForm const& form = ch.trap_form;
+    const __m256 ta      = _mm256_set1_ps(form.a);
+    const __m256 tb      = _mm256_set1_ps(form.b);
+    const __m256 tc      = _mm256_set1_ps(form.c);
+    const __m256 td      = _mm256_set1_ps(form.d);
+    const __m256 te      = _mm256_set1_ps(form.e);
+    const __m256 tf      = _mm256_set1_ps(form.f);
+
+    using State = std::conditional_t<channels, Avx2FloatTrapLanes, Avx2FloatLanes>;
+    State s[groups];
+    int pixel[groups][8];
+    int alive[groups] = {};
+    for (int g = 0; g < groups; ++g) {
+        for (int l = 0; l < 8; ++l) pixel[g][l] = -1;
+        s[g] = refill(State{}, 0xFF, pixel[g], alive[g], q);
+    }
+
+    for (unsigned t = 1; q.live > 0; ++t) {
+        for (int g = 0; g < groups; ++g) {
+            if (groups > 1 && alive[g] == 0) continue;
+            State& l  = s[g];
+            __m256 x2 = _mm256_mul_ps(l.x, l.x);
+            __m256 y2 = _mm256_mul_ps(l.y, l.y);
+            __m256 const done =
+                _mm256_or_ps(_mm256_cmp_ps(_mm256_add_ps(x2, y2), escape, _CMP_GT_OQ),
+                             _mm256_castsi256_ps(_mm256_cmpeq_epi32(l.n, mx)));
+            if (int const lanes = _mm256_movemask_ps(done)) {
+                l  = refill(l, lanes, pixel[g], alive[g], q);
+                x2 = _mm256_mul_ps(l.x, l.x);
+                y2 = _mm256_mul_ps(l.y, l.y);
+            }
+
+            l.y = _mm256_fmadd_ps(_mm256_add_ps(l.x, l.x), l.y, cy);
+            l.x = _mm256_add_ps(_mm256_sub_ps(x2, y2), l.cx);
+            l.n = _mm256_add_epi32(l.n, one);
+            if constexpr (channels) {
+                __m256 const u = _mm256_fmadd_ps(ta, l.x, _mm256_fmadd_ps(tb, l.y, tc));
+                __m256 const v = _mm256_fmadd_ps(td, l.x, _mm256_fmadd_ps(te, l.y, tf));
+                l.trap = _mm256_min_ps(_mm256_fmadd_ps(u, u, _mm256_mul_ps(v, v)), l.trap);
+            }
+
+            if (t % 8 == 0) {
+                __m256 const periodic = _mm256_and_ps(
+                    _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(l.x, l.xs), abs_mask),
+                                  epsilon, _CMP_LT_OQ),
+                    _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(l.y, l.ys), abs_mask),
+                                  epsilon, _CMP_LT_OQ));
+                l.n = _mm256_castps_si256(_mm256_blendv_ps(
+                    _mm256_castsi256_ps(l.n), _mm256_castsi256_ps(mx), periodic));
+
+                __m256i const save = _mm256_cmpgt_epi32(l.n, l.save_at);
+                l.xs      = _mm256_blendv_ps(l.xs, l.x, _mm256_castsi256_ps(save));
+                l.ys      = _mm256_blendv_ps(l.ys, l.y, _mm256_castsi256_ps(save));
+                l.save_at = _mm256_add_epi32(l.save_at, _mm256_and_si256(l.save_at, save));
+            }
+        }
+    }
+}
+
+}  // namespace
+
+/// Two groups hide most of the latency; more only add register pressure
+/// and idle groups at the end of each line
+void avx2_render_line(int* const __restrict pline, double const x1,
+                      double const x2, double const y1, int const linew,
+                      int const maxiters, LineChannels const& ch) {
+    if (ch.smooth || ch.trap)
+        avx2_refill_line<2, true>(pline, x1, x2, y1, linew, maxiters, ch);
+    else
+        avx2_refill_line<2, false>(pline, x1, x2, y1, linew, maxiters, ch);
+}
+
+void avx2_render_line_float(int* const __restrict pline, double const x1,
+                            double const x2, double const y1, int const linew,
+                            int const maxiters, LineChannels const& ch) {
+    if (ch.smooth || ch.trap)
+        avx2_refill_line_float<2, true>(pline, x1, x2, y1, linew, maxiters, ch);
+    else
+        avx2_refill_line_float<2, false>(pline, x1, x2, y1, linew, maxiters, ch);
+}
@@ -0,0 +1,207 @@
+#include <line_kernel.hpp>
+#include <simd_kernels.hpp>
+
+#include <immintrin.h>
+#include <type_traits>
+
+// Compiled with -mavx512f -mavx512dq; only called when the CPU has both
+
+namespace {
+
+struct Avx512Lanes {
+    using F = double;
+    using I = std::int64_t;
+    __m512d x, y, cx, xs, ys;
+    __m512i n, save_at;
+};
+
+struct Avx512TrapLanes : Avx512Lanes {
+    __m512d trap;
+};
+
+struct Avx512FloatLanes {
+    using F = float;
+    using I = std::int32_t;
+    __m512 x, y, cx, xs, ys;
+    __m512i n, save_at;
+};
+
+struct Avx512FloatTrapLanes : Avx512FloatLanes {
+    __m512 trap;
+};
+
+/// avx2_refill_line (kernels_avx2.cpp) with 8-lane vectors
+template<int groups, bool channels>
+void avx512_refill_line(int* const __restrict pline, double const x1,
+                        double const x2, double const y1, int const linew,
+                        int const maxiters, LineChannels const& ch) {
+    LineQueue q{.pline    = pline,
+                .x1       = x1,
+                .step     = (x2 - x1) / linew,
+                .cy       = y1,
+                .linew    = linew,
+                .maxiters = maxiters,
+                .ch       = channels ? &ch : nullptr};
+
+    const __m512d cy      = _mm512_set1_pd(y1);
+    const __m512d escape  = _mm512_set1_pd(4.0);
+    const __m512d epsilon = _mm512_set1_pd(period_epsilon);
+    const __m512i one     = _mm512_set1_epi64(1);
+    const __m512i mx      = _mm512_set1_epi64(maxiters);
+    // Only read when computing channels
+    TrapForm const& form = ch.trap_form;
+    const __m512d ta     = _mm512_set1_pd(form.a);
+    const __m512d tb     = _mm512_set1_pd(form.b);
+    const __m512d tc     = _mm512_set1_pd(form.c);
+    const __m512d td     = _mm512_set1_pd(form.d);
+    const __m512d te     = _mm512_set1_pd(form.e);
+    const __m512d tf     = _mm512_set1_pd(form.f);
+
+    using State = std::conditional_t<channels, Avx512TrapLanes, Avx512Lanes>;
+    State s[groups];
+    int pixel[groups][8];
+    int alive[groups] = {};
+    for (int g = 0; g < groups; ++g) {
+        for (int l = 0; l < 8; ++l) pixel[g][l] = -1;
+        s[g] = refill(State{}, 0xFF, pixel[g], alive[g], q);
+    }
+
+    for (unsigned t = 1; q.live > 0; ++t) {
+        for (int g = 0; g < groups; ++g) {
+            if (groups > 1 && alive[g] == 0) continue;
+            State& l = s[g];
+            __m512d x2     = _mm512_mul_pd(l.x, l.x);
+            __m512d y2     = _mm512_mul_pd(l.y, l.y);
+            __mmask8 const done =
+                _kor_mask8(_mm512_cmp_pd_mask(_mm512_add_pd(x2, y2), escape, _CMP_GT_OQ),
+                           _mm512_cmpeq_epi64_mask(l.n, mx));
+            if (int const lanes = _cvtmask8_u32(done)) {
+                l  = refill(l, lanes, pixel[g], alive[g], q);
+                x2 = _mm512_mul_pd(l.x, l.x);
+                y2 = _mm512_mul_pd(l.y, l.y);
+            }
+
+            l.y = _mm512_fmadd_pd(_mm512_add_pd(l.x, l.x), l.y, cy);
+            l.x = _mm512_add_pd(_mm512_sub_pd(x2, y2), l.cx);
+            l.n = _mm512_add_epi64(l.n, one);
+            if constexpr (channels) {
+                __m512d const u = _mm512_fmadd_pd(ta, l.x, _mm512_fmadd_pd(tb, l.y, tc));
+                __m512d const v = _mm512_fmadd_pd(td, l.x, _mm512_fmadd_pd(te, l.y, tf));
+                // The zero-masking form: GCC 12 warns that the plain one's
+                // undefined passthrough may be used uninitialized
+                l.trap = _mm512_maskz_min_pd(0xFF, _mm512_fmadd_pd(u, u, _mm512_mul_pd(v, v)),
+                                             l.trap);
+            }
+
+            if (t % 8 == 0) {
+                __mmask8 const periodic = _mm512_mask_cmp_pd_mask(
+                    _mm512_cmp_pd_mask(_mm512_abs_pd(_mm512_sub_pd(l.x, l.xs)),
+                                       epsilon, _CMP_LT_OQ),
+                    _mm512_abs_pd(_mm512_sub_pd(l.y, l.ys)), epsilon, _CMP_LT_OQ);
+                l.n = _mm512_mask_mov_epi64(l.n, periodic, mx);
+
+                __mmask8 const save = _mm512_cmpgt_epi64_mask(l.n, l.save_at);
+                l.xs      = _mm512_mask_mov_pd(l.xs, save, l.x);
+                l.ys      = _mm512_mask_mov_pd(l.ys, save, l.y);
+                l.save_at = _mm512_mask_add_epi64(l.save_at, save, l.save_at, l.save_at);
+            }
+        }
+    }
+}
+
+/// avx2_refill_line_float (kernels_avx2.cpp) with 16-lane vectors
+template<int groups, bool channels>
+void avx512_refill_line_float(int* const __restrict pline, double const x1,
+                              double const x2, double const y1,
+                              int const linew, int const maxiters, LineChannels const& ch) {
+    LineQueue q{.pline    = pline,
+                .x1       = x1,
+                .step     = (x2 - x1) / linew,
+                .cy       = y1,
+                .linew    = linew,
+                .maxiters = maxiters,
+                .ch       = channels ? &ch : nullptr};
+
+    const __m512 cy      = _mm512_set1_ps(static_cast<float>(y1));
+    const __m512 escape  = _mm512_set1_ps(4.0f);
+    const __m512 epsilon = _mm512_set1_ps(period_epsilon_float);
+    const __m512i one    = _mm512_set1_epi32(1);
+    const __m512i mx     = _mm512_set1_epi32(maxiters);
+    // Only read when computing channels
+    TrapForm const& form = ch.trap_form;
+    const __m512 ta      = _mm512_set1_ps(form.a);
+    const __m512 tb      = _mm512_set1_ps(form.b);
+    const __m512 tc      = _mm512_set1_ps(form.c);
+    const __m512 td      = _mm512_set1_ps(form.d);
+    const __m512 te      = _mm512_set1_ps(form.e);
+    const __m512 tf      = _mm512_set1_ps(form.f);
+
+    using State = std::conditional_t<channels, Avx512FloatTrapLanes, Avx512FloatLanes>;
+    State s[groups];
+    int pixel[groups][16];
+    int alive[groups] = {};
+    for (int g = 0; g < groups; ++g) {
+        for (int l = 0; l < 16; ++l) pixel[g][l] = -1;
+        s[g] = refill(State{}, 0xFFFF, pixel[g], alive[g], q);
+    }
+
+    for (unsigned t = 1; q.live > 0; ++t) {
+        for (int g = 0; g < groups; ++g) {
+            if (groups > 1 && alive[g] == 0) continue;
+            State& l  = s[g];
+            __m512 x2 = _mm512_mul_ps(l.x, l.x);
+            __m512 y2 = _mm512_mul_ps(l.y, l.y);
+            __mmask16 const done =
+                _kor_mask16(_mm512_cmp_ps_mask(_mm512_add_ps(x2, y2), escape, _CMP_GT_OQ),
+                            _mm512_cmpeq_epi32_mask(l.n, mx));
+            if (int const lanes = _cvtmask16_u32(done)) {
+                l  = refill(l, lanes, pixel[g], alive[g], q);
+                x2 = _mm512_mul_ps(l.x, l.x);
+                y2 = _mm512_mul_ps(l.y, l.y);
+            }
+
+            l.y = _mm512_fmadd_ps(_mm512_add_ps(l.x, l.x), l.y, cy);
+            l.x = _mm512_add_ps(_mm512_sub_ps(x2, y2), l.cx);
+            l.n = _mm512_add_epi32(l.n, one);
+            if constexpr (channels) {
+                __m512 const u = _mm512_fmadd_ps(ta, l.x, _mm512_fmadd_ps(tb, l.y, tc));
+                __m512 const v = _mm512_fmadd_ps(td, l.x, _mm512_fmadd_ps(te, l.y, tf));
+                l.trap = _mm512_maskz_min_ps(0xFFFF, _mm512_fmadd_ps(u, u, _mm512_mul_ps(v, v)),
+                                             l.trap);
+            }
+
+            if (t % 8 == 0) {
+                __mmask16 const periodic = _mm512_mask_cmp_ps_mask(
+                    _mm512_cmp_ps_mask(_mm512_abs_ps(_mm512_sub_ps(l.x, l.xs)),
+                                       epsilon, _CMP_LT_OQ),
+                    _mm512_abs_ps(_mm512_sub_ps(l.y, l.ys)), epsilon, _CMP_LT_OQ);
+                l.n = _mm512_mask_mov_epi32(l.n, periodic, mx);
+
+                __mmask16 const save = _mm512_cmpgt_epi32_mask(l.n, l.save_at);
+                l.xs      = _mm512_mask_mov_ps(l.xs, save, l.x);
+                l.ys      = _mm512_mask_mov_ps(l.ys, save, l.y);
+                l.save_at = _mm512_mask_add_epi32(l.save_at, save, l.save_at, l.save_at);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+void avx512_render_line(int* const __restrict pline, double const x1,
+                        double const x2, double const y1, int const linew,
+                        int const maxiters, LineChannels const& ch) {
+    if (ch.smooth || ch.trap)
+        avx512_refill_line<2, true>(pline, x1, x2, y1, linew, maxiters, ch);
+    else
+        avx512_refill_line<2, false>(pline, x1, x2, y1, linew, maxiters, ch);
+}
+
+void avx512_render_line_float(int* const __restrict pline, double const x1,
+                              double const x2, double const y1,
+                              int const linew, int const maxiters, LineChannels const& ch) {
+    if (ch.smooth || ch.trap)
+        avx512_refill_line_float<2, true>(pline, x1, x2, y1, linew, maxiters, ch);
+    else
+        avx512_refill_line_float<2, false>(pline, x1, x2, y1, linew, maxiters, ch);
+}
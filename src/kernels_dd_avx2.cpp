@@ -0,0 +1,37 @@
+#include <dd_kernel.hpp>
+#include <simd_kernels.hpp>
+
+#include <immintrin.h>
+
+// Compiled with -mavx2 -mfma -ffp-contract=off; only called when the CPU
+// has both
+
+namespace {
+
+struct Avx2Dd {
+    using V = __m256d;
+    using M = __m256d;
+    static constexpr int N = 4;
+
+    static V set1(double a) { return _mm256_set1_pd(a); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static V prod_error(V a, V b, V p) { return _mm256_fmsub_pd(a, b, p); }
+    static M gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static M eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static M both(M a, M b) { return _mm256_and_pd(a, b); }
+    static M either(M a, M b) { return _mm256_or_pd(a, b); }
+    static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+    static int bits(M m) { return _mm256_movemask_pd(m); }
+};
+
+}  // namespace
+
+void avx2_render_line_dd(int* const __restrict pline, DoubleDouble const x1,
+                         double const step, DoubleDouble const y1, int const linew,
+                         int const maxiters) {
+    dd_render_line<Avx2Dd, 2>(pline, x1, step, y1, linew, maxiters);
+}
@@ -0,0 +1,37 @@
+#include <dd_kernel.hpp>
+#include <simd_kernels.hpp>
+
+#include <immintrin.h>
+
+// Compiled with -mavx512f -mavx512dq -ffp-contract=off; only called when
+// the CPU has both
+
+namespace {
+
+struct Avx512Dd {
+    using V = __m512d;
+    using M = __mmask8;
+    static constexpr int N = 8;
+
+    static V set1(double a) { return _mm512_set1_pd(a); }
+    static V add(V a, V b) { return _mm512_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm512_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_pd(a, b); }
+    static V abs(V a) { return _mm512_abs_pd(a); }
+    static V prod_error(V a, V b, V p) { return _mm512_fmsub_pd(a, b, p); }
+    static M gt(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    static M lt(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static M eq(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static M both(M a, M b) { return _kand_mask8(a, b); }
+    static M either(M a, M b) { return _kor_mask8(a, b); }
+    static V select(M m, V a, V b) { return _mm512_mask_blend_pd(m, b, a); }
+    static int bits(M m) { return m; }
+};
+
+}  // namespace
+
+void avx512_render_line_dd(int* const __restrict pline, DoubleDouble const x1,
+                           double const step, DoubleDouble const y1, int const linew,
+                           int const maxiters) {
+    dd_render_line<Avx512Dd, 2>(pline, x1, step, y1, linew, maxiters);
+}
@@ -0,0 +1,43 @@
+#include <dd_kernel.hpp>
+#include <simd_kernels.hpp>
+
+#include <emmintrin.h>
+
+// Baseline x86-64 with -ffp-contract=off, see dd_kernel.hpp
+
+namespace {
+
+struct Sse2Dd {
+    using V = __m128d;
+    using M = __m128d;
+    static constexpr int N = 2;
+
+    static V set1(double a) { return _mm_set1_pd(a); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V abs(V a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    /// Without FMA, by Dekker's split of both factors into 26-bit halves
+    static V prod_error(V a, V b, V p) {
+        V const split = _mm_set1_pd(134217729.0);  // 2^27 + 1
+        V const ta = mul(split, a), tb = mul(split, b);
+        V const ah = sub(ta, sub(ta, a)), al = sub(a, ah);
+        V const bh = sub(tb, sub(tb, b)), bl = sub(b, bh);
+        return add(add(add(sub(mul(ah, bh), p), mul(ah, bl)), mul(al, bh)), mul(al, bl));
+    }
+    static M gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+    static M lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+    static M eq(V a, V b) { return _mm_cmpeq_pd(a, b); }
+    static M both(M a, M b) { return _mm_and_pd(a, b); }
+    static M either(M a, M b) { return _mm_or_pd(a, b); }
+    static V select(M m, V a, V b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+    static int bits(M m) { return _mm_movemask_pd(m); }
+};
+
+}  // namespace
+
+void sse2_render_line_dd(int* const __restrict pline, DoubleDouble const x1,
+                         double const step, DoubleDouble const y1, int const linew,
+                         int const maxiters) {
+    dd_render_line<Sse2Dd, 2>(pline, x1, step, y1, linew, maxiters);
+}
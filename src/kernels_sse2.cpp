@@ -0,0 +1,217 @@
+#include <line_kernel.hpp>
+#include <simd_kernels.hpp>
+
+#include <emmintrin.h>
+#include <type_traits>
+
+// Baseline x86-64: no FMA, no blends and no 64-bit integer compares
+
+namespace {
+
+/// SSE2 has no 64-bit integer compares, so the double kernel counts
+/// iterations in doubles, which are exact far beyond any maxiters
+struct Sse2Lanes {
+    using F = double;
+    using I = double;
+    __m128d x, y, cx, xs, ys;
+    __m128d n, save_at;
+};
+
+struct Sse2TrapLanes : Sse2Lanes {
+    __m128d trap;
+};
+
+struct Sse2FloatLanes {
+    using F = float;
+    using I = std::int32_t;
+    __m128 x, y, cx, xs, ys;
+    __m128i n, save_at;
+};
+
+struct Sse2FloatTrapLanes : Sse2FloatLanes {
+    __m128 trap;
+};
+
+__m128d select(__m128d mask, __m128d a, __m128d b) {
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+__m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/// avx2_refill_line (kernels_avx2.cpp) with 2-lane vectors and a separate
+/// multiply and add
+template<int groups, bool channels>
+void sse2_refill_line(int* const __restrict pline, double const x1,
+                      double const x2, double const y1, int const linew,
+                      int const maxiters, LineChannels const& ch) {
+    LineQueue q{.pline    = pline,
+                .x1       = x1,
+                .step     = (x2 - x1) / linew,
+                .cy       = y1,
+                .linew    = linew,
+                .maxiters = maxiters,
+                .ch       = channels ? &ch : nullptr};
+
+    const __m128d cy       = _mm_set1_pd(y1);
+    const __m128d escape   = _mm_set1_pd(4.0);
+    const __m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(INT64_MAX));
+    const __m128d epsilon  = _mm_set1_pd(period_epsilon);
+    const __m128d one      = _mm_set1_pd(1.0);
+    const __m128d mx       = _mm_set1_pd(maxiters);
+    // Only read when computing channels
+    TrapForm const& form = ch.trap_form;
+    const __m128d ta     = _mm_set1_pd(form.a);
+    const __m128d tb     = _mm_set1_pd(form.b);
+    const __m128d tc     = _mm_set1_pd(form.c);
+    const __m128d td     = _mm_set1_pd(form.d);
+    const __m128d te     = _mm_set1_pd(form.e);
+    const __m128d tf     = _mm_set1_pd(form.f);
+
+    using State = std::conditional_t<channels, Sse2TrapLanes, Sse2Lanes>;
+    State s[groups];
+    int pixel[groups][2];
+    int alive[groups] = {};
+    for (int g = 0; g < groups; ++g) {
+        for (int l = 0; l < 2; ++l) pixel[g][l] = -1;
+        s[g] = refill(State{}, 0x3, pixel[g], alive[g], q);
+    }
+
+    for (unsigned t = 1; q.live > 0; ++t) {
+        for (int g = 0; g < groups; ++g) {
+            if (groups > 1 && alive[g] == 0) continue;
+            State& l   = s[g];
+            __m128d x2 = _mm_mul_pd(l.x, l.x);
+            __m128d y2 = _mm_mul_pd(l.y, l.y);
+            __m128d const done = _mm_or_pd(_mm_cmpgt_pd(_mm_add_pd(x2, y2), escape),
+                                           _mm_cmpeq_pd(l.n, mx));
+            if (int const lanes = _mm_movemask_pd(done)) {
+                l  = refill(l, lanes, pixel[g], alive[g], q);
+                x2 = _mm_mul_pd(l.x, l.x);
+                y2 = _mm_mul_pd(l.y, l.y);
+            }
+
+            l.y = _mm_add_pd(_mm_mul_pd(_mm_add_pd(l.x, l.x), l.y), cy);
+            l.x = _mm_add_pd(_mm_sub_pd(x2, y2), l.cx);
+            l.n = _mm_add_pd(l.n, one);
+            if constexpr (channels) {
+                __m128d const u = _mm_add_pd(_mm_mul_pd(ta, l.x),
+                                             _mm_add_pd(_mm_mul_pd(tb, l.y), tc));
+                __m128d const v = _mm_add_pd(_mm_mul_pd(td, l.x),
+                                             _mm_add_pd(_mm_mul_pd(te, l.y), tf));
+                l.trap = _mm_min_pd(_mm_add_pd(_mm_mul_pd(u, u), _mm_mul_pd(v, v)), l.trap);
+            }
+
+            if (t % 8 == 0) {
+                __m128d const periodic = _mm_and_pd(
+                    _mm_cmplt_pd(_mm_and_pd(_mm_sub_pd(l.x, l.xs), abs_mask), epsilon),
+                    _mm_cmplt_pd(_mm_and_pd(_mm_sub_pd(l.y, l.ys), abs_mask), epsilon));
+                l.n = select(periodic, mx, l.n);
+
+                __m128d const save = _mm_cmpgt_pd(l.n, l.save_at);
+                l.xs      = select(save, l.x, l.xs);
+                l.ys      = select(save, l.y, l.ys);
+                l.save_at = _mm_add_pd(l.save_at, _mm_and_pd(l.save_at, save));
+            }
+        }
+    }
+}
+
+/// sse2_refill_line on 4 floats per vector
+template<int groups, bool channels>
+void sse2_refill_line_float(int* const __restrict pline, double const x1,
+                            double const x2, double const y1, int const linew,
+                            int const maxiters, LineChannels const& ch) {
+    LineQueue q{.pline    = pline,
+                .x1       = x1,
+                .step     = (x2 - x1) / linew,
+                .cy       = y1,
+                .linew    = linew,
+                .maxiters = maxiters,
+                .ch       = channels ? &ch : nullptr};
+
+    const __m128 cy       = _mm_set1_ps(static_cast<float>(y1));
+    const __m128 escape   = _mm_set1_ps(4.0f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(INT32_MAX));
+    const __m128 epsilon  = _mm_set1_ps(period_epsilon_float);
+    const __m128i one     = _mm_set1_epi32(1);
+    const __m128i mx      = _mm_set1_epi32(maxiters);
+    // Only read when computing channels
+    TrapForm const& form = ch.trap_form;
+    const __m128 ta      = _mm_set1_ps(form.a);
+    const __m128 tb      = _mm_set1_ps(form.b);
+    const __m128 tc      = _mm_set1_ps(form.c);
+    const __m128 td      = _mm_set1_ps(form.d);
+    const __m128 te      = _mm_set1_ps(form.e);
+    const __m128 tf      = _mm_set1_ps(form.f);
+
+    using State = std::conditional_t<channels, Sse2FloatTrapLanes, Sse2FloatLanes>;
+    State s[groups];
+    int pixel[groups][4];
+    int alive[groups] = {};
+    for (int g = 0; g < groups; ++g) {
+        for (int l = 0; l < 4; ++l) pixel[g][l] = -1;
+        s[g] = refill(State{}, 0xF, pixel[g], alive[g], q);
+    }
+
+    for (unsigned t = 1; q.live > 0; ++t) {
+        for (int g = 0; g < groups; ++g) {
+            if (groups > 1 && alive[g] == 0) continue;
+            State& l  = s[g];
+            __m128 x2 = _mm_mul_ps(l.x, l.x);
+            __m128 y2 = _mm_mul_ps(l.y, l.y);
+            __m128 const done = _mm_or_ps(_mm_cmpgt_ps(_mm_add_ps(x2, y2), escape),
+                                          _mm_castsi128_ps(_mm_cmpeq_epi32(l.n, mx)));
+            if (int const lanes = _mm_movemask_ps(done)) {
+                l  = refill(l, lanes, pixel[g], alive[g], q);
+                x2 = _mm_mul_ps(l.x, l.x);
+                y2 = _mm_mul_ps(l.y, l.y);
+            }
+
+            l.y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(l.x, l.x), l.y), cy);
+            l.x = _mm_add_ps(_mm_sub_ps(x2, y2), l.cx);
+            l.n = _mm_add_epi32(l.n, one);
+            if constexpr (channels) {
+                __m128 const u = _mm_add_ps(_mm_mul_ps(ta, l.x),
+                                            _mm_add_ps(_mm_mul_ps(tb, l.y), tc));
+                __m128 const v = _mm_add_ps(_mm_mul_ps(td, l.x),
+                                            _mm_add_ps(_mm_mul_ps(te, l.y), tf));
+                l.trap = _mm_min_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)), l.trap);
+            }
+
+            if (t % 8 == 0) {
+                __m128 const periodic = _mm_and_ps(
+                    _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(l.x, l.xs), abs_mask), epsilon),
+                    _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(l.y, l.ys), abs_mask), epsilon));
+                l.n = _mm_castps_si128(select(periodic, _mm_castsi128_ps(mx),
+                                              _mm_castsi128_ps(l.n)));
+
+                __m128i const save = _mm_cmpgt_epi32(l.n, l.save_at);
+                l.xs      = select(_mm_castsi128_ps(save), l.x, l.xs);
+                l.ys      = select(_mm_castsi128_ps(save), l.y, l.ys);
+                l.save_at = _mm_add_epi32(l.save_at, _mm_and_si128(l.save_at, save));
+            }
+        }
+    }
+}
+
+}  // namespace
+
+void sse2_render_line(int* const __restrict pline, double const x1,
+                      double const x2, double const y1, int const linew,
+                      int const maxiters, LineChannels const& ch) {
+    if (ch.smooth || ch.trap)
+        sse2_refill_line<2, true>(pline, x1, x2, y1, linew, maxiters, ch);
+    else
+        sse2_refill_line<2, false>(pline, x1, x2, y1, linew, maxiters, ch);
+}
+
+void sse2_render_line_float(int* const __restrict pline, double const x1,
+                            double const x2, double const y1, int const linew,
+                            int const maxiters, LineChannels const& ch) {
+    if (ch.smooth || ch.trap)
+        sse2_refill_line_float<2, true>(pline, x1, x2, y1, linew, maxiters, ch);
+    else
+        sse2_refill_line_float<2, false>(pline, x1, x2, y1, linew, maxiters, ch);
+}
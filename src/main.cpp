@@ -1,4 +1,6 @@
 #include <cassert>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 
 #include <mandel.hpp>
@@ -76,6 +78,14 @@ Gtk::Window& get_main_window() {
 }
 
 int main(int argc, char** argv) {
-    auto App = Gtk::Application::create("org.fractal.mr");
-    return App->make_window_and_run<Viewer>(argc, argv);
+    trace::name_thread("gui");
+    auto App      = Gtk::Application::create("org.fractal.mr");
+    int const res = App->make_window_and_run<Viewer>(argc, argv);
+
+    // FRACTAL_TRACE=file.json saves what was recorded on exit
+    if (char const* path = std::getenv("FRACTAL_TRACE"); trace::enabled && path) {
+        std::ofstream out(path);
+        trace::write_chrome_trace(out);
+    }
+    return res;
 }
@@ -0,0 +1,883 @@
+#include <line_kernel.hpp>
+#include <mandel_engine.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+/// Pixel spacing of the job relative to the largest coordinate its orbits
+/// reach. They stay within |z| <= 2 until they escape, so that bounds the
+/// magnitude even near the origin.
+double relative_spacing(MandelJob const& job) {
+    vec2 const tl = job.viewport.top_left;
+    vec2 const br = job.viewport.screen_to_world({job.width, job.height});
+    double const magnitude = std::max({2.0, std::abs(tl.x()), std::abs(tl.y()),
+                                       std::abs(br.x()), std::abs(br.y())});
+    return job.viewport.pixel_size() / magnitude;
+}
+
+/// Smallest relative spacing double-double resolves. Its sums are accurate
+/// to about 2^-104 of |z| (see dd_add), so this keeps 4 bits below the
+/// spacing, and the spacing above period_epsilon_dd.
+constexpr double double_double_limit = 0x1p-100;
+
+/// Nearest double-double to x
+DoubleDouble to_double_double(mpf_class const& x) {
+    double const hi = x.get_d();
+    mpf_class const rest(x - hi, x.get_prec());
+    return DoubleDouble{hi, 0} + rest.get_d();
+}
+
+int iters_for(double cx, double cy, int mx) {
+    if (in_main_bulbs(cx, cy)) return mx;
+
+    double x = 0, y = 0, x2 = 0, y2 = 0;
+    // Brent's cycle detection: compare against the point saved at the last
+    // power of two
+    double xs = 0, ys = 0;
+    int next_save = 1;
+    int iters     = 0;
+    for (; iters < mx; ++iters) {
+        if (x2 + y2 > 4) break;
+        y  = std::fma(x + x, y, cy);
+        x  = x2 - y2 + cx;
+        x2 = x * x;
+        y2 = y * y;
+
+        if (std::abs(x - xs) < period_epsilon && std::abs(y - ys) < period_epsilon)
+            return mx;
+        if (iters == next_save) {
+            xs        = x;
+            ys        = y;
+            next_save *= 2;
+        }
+    }
+    return iters;
+}
+
+/// Colours of even and odd escape times in black-and-white mode, so that
+/// the set itself is black
+std::array<argb32, 2> parity_colors(int max_iters) {
+    constexpr argb32 black = 0xff000000, white = 0xffffffff;
+    return max_iters % 2 == 1 ? std::array{white, black} : std::array{black, white};
+}
+
+/// Sum of the channel differences of two colours
+int color_distance(argb32 a, argb32 b) {
+    int d = 0;
+    for (int s = 0; s < 24; s += 8) d += std::abs(int(a >> s & 0xff) - int(b >> s & 0xff));
+    return d;
+}
+
+}  // namespace
+
+
+FrameBuffer<int> MandelbrotEngine::calculate_iters(MandelJob const& job) {
+    int const w = job.width, h = job.height;
+    FrameBuffer<int> iterations = buffers.take(std::size_t(w) * h);
+    vec2 tl = job.viewport.screen_to_world({0, 0});
+    vec2 br = job.viewport.screen_to_world({w, h});
+    vec2 sz = br - tl;
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int iters = 0;
+            std::complex c{
+                tl.x() + sz.x() * (double(x) / w),
+                tl.y() + sz.y() * (double(y) / h),
+            };
+            std::complex z{0.0, 0.0};
+            for (; iters < job.max_iters; ++iters) {
+                if (std::norm(z) > 4.0) break;
+                z = z * z + c;
+            }
+            iterations[y * w + x] = iters;
+        }
+    }
+    return iterations;
+}
+
+FrameBuffer<int> MandelbrotEngine::optimized_escape_times(MandelJob const& job) {
+    int const w   = job.width;
+    int const h   = job.height;
+    int const mx  = job.max_iters;
+    const vec2 tl = job.viewport.top_left;
+    double const step = job.viewport.pixel_size();
+
+    FrameBuffer<int> res = buffers.take(std::size_t(w) * h);
+
+    auto calc = [&, tl, step](int sy1, int sy2) {
+        for (int j = sy1; j < sy2; ++j) {
+            const double cy = tl.y() + step * j;
+            for (int i = 0; i < w; ++i) {
+                const double cx = tl.x() + step * i;
+                res[i + j * w]  = iters_for(cx, cy, mx);
+            }
+        }
+    };
+    auto const costs = probe_row_costs<int>(tpool, w, h, [&](int y, std::span<int> line) {
+        for (int k = 0; k < int(line.size()); ++k) {
+            line[k] = iters_for(tl.x() + step * probe_step * k, tl.y() + step * y, mx);
+        }
+    });
+    run_chunks(costs, res, calc);
+
+    return res;
+}
+
+FrameBuffer<int> MandelbrotEngine::simd_escape_times(MandelJob const& job,
+                                                     LineSampler const& alg,
+                                                     LineChannels const& ch) {
+    int const w  = job.width;
+    int const h  = job.height;
+    int const mx = job.max_iters;
+
+    FrameBuffer<int> res = buffers.take(std::size_t(w) * h);
+
+    auto exec_lines = [&](int sy1, int sy2) {
+        for (int line = sy1; line < sy2; ++line) {
+            LineChannels row = ch;
+            if (row.smooth) row.smooth += line * w;
+            if (row.trap) row.trap += line * w;
+            alg(res.data() + line * w, 0, line, 1, w, mx, row);
+        }
+    };
+    // The probe spans the same x range at a probe_step-th of the pixels
+    auto const costs = probe_row_costs<int>(tpool, w, h, [&](int y, std::span<int> line) {
+        alg(line.data(), 0, y, probe_step, line.size(), mx);
+    });
+    run_chunks(costs, res, exec_lines);
+
+    return res;
+}
+
+FrameBuffer<int> MandelbrotEngine::subdivided_escape_times(MandelJob const& job,
+                                                           LineSampler const& alg) {
+    int const w = job.width;
+    int const h = job.height;
+    if (w < 3 || h < 3) return simd_escape_times(job, alg);
+
+    constexpr int tile    = 64;  // side of the boxes rendered in parallel
+    constexpr int min_box = 8;   // boxes this small are computed directly
+
+    int const mx      = job.max_iters;
+    const vec2 tl     = job.viewport.top_left;
+    double const step = job.viewport.pixel_size();
+
+    FrameBuffer<int> res = buffers.take(std::size_t(w) * h);
+
+    // Pixels [x1, x2) of line y through the line kernel
+    auto row = [&](int y, int x1, int x2) {
+        alg(res.data() + y * w + x1, x1, y, 1, x2 - x1, mx);
+    };
+    // Pixels [y1, y2) of column x, one by one through the kernel when
+    // doubles cannot resolve them
+    auto column = [&](int x, int y1, int y2) {
+        double const cx = tl.x() + step * x;
+        for (int y = y1; y < y2; ++y) {
+            if (alg.dd_kernel)
+                alg(&res[y * w + x], x, y, 1, 1, mx);
+            else
+                res[y * w + x] = iters_for(cx, tl.y() + step * y, mx);
+        }
+    };
+
+    // Box with inclusive corners (x1, y1) and (x2, y2) whose border is
+    // already computed. A uniform border is assumed to enclose a uniform
+    // area, which is exact for the interior since the set has no holes.
+    auto fill = [&](auto& self, int x1, int y1, int x2, int y2) -> void {
+        if (x2 - x1 < 2 || y2 - y1 < 2) return;
+
+        int const v  = res[y1 * w + x1];
+        bool uniform = true;
+        for (int x = x1; x <= x2 && uniform; ++x) {
+            uniform = res[y1 * w + x] == v && res[y2 * w + x] == v;
+        }
+        for (int y = y1 + 1; y < y2 && uniform; ++y) {
+            uniform = res[y * w + x1] == v && res[y * w + x2] == v;
+        }
+        if (uniform) {
+            for (int y = y1 + 1; y < y2; ++y) {
+                std::fill(res.begin() + y * w + x1 + 1, res.begin() + y * w + x2, v);
+            }
+            return;
+        }
+
+        if (x2 - x1 <= min_box || y2 - y1 <= min_box) {
+            for (int y = y1 + 1; y < y2; ++y) row(y, x1 + 1, x2);
+            return;
+        }
+
+        int const xm = (x1 + x2) / 2;
+        int const ym = (y1 + y2) / 2;
+        row(ym, x1 + 1, x2);
+        column(xm, y1 + 1, ym);
+        column(xm, ym + 1, y2);
+        self(self, x1, y1, xm, ym);
+        self(self, xm, y1, x2, ym);
+        self(self, x1, ym, xm, y2);
+        self(self, xm, ym, x2, y2);
+    };
+
+    // Grid lines shared by neighbouring tiles, including the image border
+    auto grid = [](int size) {
+        std::vector<int> lines;
+        for (int i = 0; i < size - 1; i += tile) lines.push_back(i);
+        lines.push_back(size - 1);
+        return lines;
+    };
+    std::vector<int> const xs = grid(w);
+    std::vector<int> const ys = grid(h);
+
+    int const cols = xs.size(), rows = ys.size();
+    tpool.parallel_for(0, rows, [&](int j1, int j2) {
+        for (int j = j1; j < j2; ++j) row(ys[j], 0, w);
+    });
+    tpool.parallel_for(0, cols, [&](int i1, int i2) {
+        for (int i = i1; i < i2; ++i) {
+            for (int j = 0; j + 1 < rows; ++j) column(xs[i], ys[j] + 1, ys[j + 1]);
+        }
+    });
+    tpool.parallel_for_2d(cols - 1, rows - 1, 1, 1, [&](int i, int j, int, int) {
+        fill(fill, xs[i], ys[j], xs[i + 1], ys[j + 1]);
+    });
+
+    return res;
+}
+
+std::optional<vec2i> MandelbrotEngine::reusable_shift(MandelJob const& job) const {
+    if (!last_job || last_job->width != job.width
+        || last_job->height != job.height
+        || last_job->max_iters != job.max_iters
+        || last_job->algorithm != job.algorithm
+        || last_job->subdivide != job.subdivide
+        || last_job->precision != job.precision)
+        return std::nullopt;
+    return pixel_shift(last_job->viewport, job.viewport, job.width, job.height);
+}
+
+KernelPrecision MandelbrotEngine::kernel_precision(MandelJob const& job) {
+    switch (job.algorithm) {
+    case MandelAlgorithm::AVX2:
+    case MandelAlgorithm::AVX512:
+    case MandelAlgorithm::HISTOGRAM:
+    case MandelAlgorithm::BLACK_AND_WHITE: break;
+    default: return KernelPrecision::DOUBLE;
+    }
+    if (job.precision != KernelPrecision::AUTO) return job.precision;
+
+    // Keep 8 bits of mantissa below the pixel spacing
+    double const spacing = relative_spacing(job);
+    if (spacing >= std::numeric_limits<float>::epsilon() * 256)
+        return KernelPrecision::SINGLE;
+    if (spacing >= std::numeric_limits<double>::epsilon() * 256)
+        return KernelPrecision::DOUBLE;
+    return KernelPrecision::DOUBLE_DOUBLE;
+}
+
+SimdLevel MandelbrotEngine::simd_level(MandelJob const& job) {
+    SimdLevel const best = detected_simd_level();
+    if (job.algorithm == MandelAlgorithm::AVX2) return std::min(best, SimdLevel::AVX2);
+    return best;
+}
+
+std::string MandelbrotEngine::kernel_name(MandelJob const& job) {
+    switch (resolved(job).algorithm) {
+    case MandelAlgorithm::DEFAULT:
+    case MandelAlgorithm::OPTIMIZED: return "scalar";
+    case MandelAlgorithm::DEEP_ZOOM: return "perturbation";
+    default: break;
+    }
+    char const* const arithmetic[] = {"", " double", " float", " double-double"};
+    return simd_level_name(simd_level(job))
+           + std::string(arithmetic[int(kernel_precision(job))]);
+}
+
+MandelJob MandelbrotEngine::resolved(MandelJob job) {
+    job.precision = kernel_precision(job);
+    if (job.precision == KernelPrecision::DOUBLE_DOUBLE
+        && relative_spacing(job) < double_double_limit)
+        job.algorithm = MandelAlgorithm::DEEP_ZOOM;
+    return job;
+}
+
+MandelbrotEngine::LineSampler MandelbrotEngine::line_sampler(MandelJob const& job) {
+    KernelPrecision const precision = kernel_precision(job);
+    LineSampler line{.top_left = job.viewport.top_left, .step = job.viewport.pixel_size()};
+    if (precision != KernelPrecision::DOUBLE_DOUBLE) {
+        line.kernel = line_kernel_for(simd_level(job), precision == KernelPrecision::SINGLE);
+        return line;
+    }
+    line.dd_kernel = dd_line_kernel_for(simd_level(job));
+    if (auto const& p = job.viewport.precise_top_left) {
+        line.left = to_double_double(p->x);
+        line.top  = to_double_double(p->y);
+    } else {
+        line.left = {line.top_left.x(), 0};
+        line.top  = {line.top_left.y(), 0};
+    }
+    return line;
+}
+
+void MandelbrotEngine::LineSampler::operator()(int* out, double x, double y, double spacing,
+                                               int n, int mx, LineChannels const& ch) const {
+    if (dd_kernel) {
+        dd_kernel(out, left + step * x, step * spacing, top + step * y, n, mx);
+    } else {
+        kernel(out, top_left.x() + step * x, top_left.x() + step * (x + spacing * n),
+               top_left.y() + step * y, n, mx, ch);
+    }
+}
+
+FrameBuffer<int> MandelbrotEngine::escape_times(MandelJob const& requested,
+                                                RenderControl<int> const& ctl) {
+    // Strips and tiles all use the precision chosen for the whole frame
+    MandelJob const job = resolved(requested);
+
+    // Every band of a deep zoom would need its own reference orbit
+    RenderControl<int> banded = ctl;
+    if (job.algorithm == MandelAlgorithm::DEEP_ZOOM) banded.bands = 1;
+
+    auto res = render_frame(last_iters, buffers, job.width, job.height,
+                            reusable_shift(job), banded,
+                            [&](int x, int y, int w, int h) {
+                                MandelJob strip = job;
+                                strip.viewport  = job.viewport.shifted({x, y});
+                                strip.width     = w;
+                                strip.height    = h;
+                                return cached_escape_times(strip);
+                            });
+
+    // Keep a copy for the next pan in a recycled buffer
+    FrameBuffer<int> kept = buffers.take(res.size());
+    std::copy(res.begin(), res.end(), kept.begin());
+    buffers.give(std::exchange(last_iters, std::move(kept)));
+    last_job = job;
+    return res;
+}
+
+FrameBuffer<int> MandelbrotEngine::cached_escape_times(MandelJob const& job) {
+    // Deep zoom leaves the range where tiles can be addressed with int64s
+    auto const origin = grid_origin(job.viewport);
+    if (!origin || job.algorithm == MandelAlgorithm::DEEP_ZOOM
+        || cache.get_budget() == 0)
+        return compute_escape_times(job);
+
+    constexpr int T     = TileCache::tile_size;
+    int const w         = job.width;
+    int const h         = job.height;
+    auto const [gx, gy] = *origin;
+    auto tile_of        = [](std::int64_t p) {
+        return p >= 0 ? p / T : -((-p + T - 1) / T);
+    };
+    std::int64_t const tx0 = tile_of(gx), tx1 = tile_of(gx + w - 1);
+    std::int64_t const ty0 = tile_of(gy), ty1 = tile_of(gy + h - 1);
+    int const columns      = tx1 - tx0 + 1;
+
+    FrameBuffer<int> res = buffers.take(std::size_t(w) * h);
+    auto key = [&](std::int64_t tx, std::int64_t ty) {
+        return TileKey{job.viewport.scale, job.max_iters, job.algorithm,
+                       job.subdivide,      job.precision, tx, ty};
+    };
+    // Copy the part of a tile that lies inside the job
+    auto paste = [&](int const* tile, int tile_stride, std::int64_t tx,
+                     std::int64_t ty) {
+        std::int64_t const x1 = std::max(tx * T, gx), x2 = std::min(tx * T + T, gx + w);
+        std::int64_t const y1 = std::max(ty * T, gy), y2 = std::min(ty * T + T, gy + h);
+        for (std::int64_t y = y1; y < y2; ++y) {
+            std::copy(tile + (y - ty * T) * tile_stride + (x1 - tx * T),
+                      tile + (y - ty * T) * tile_stride + (x2 - tx * T),
+                      res.begin() + (y - gy) * w + (x1 - gx));
+        }
+    };
+
+    std::vector<TileCache::Tile> row(columns);
+    for (std::int64_t ty = ty0; ty <= ty1; ++ty) {
+        for (int i = 0; i < columns; ++i) {
+            row[i] = cache.find(key(tx0 + i, ty));
+            if (row[i]) paste(row[i]->data(), T, tx0 + i, ty);
+        }
+
+        // Each run of missing tiles is computed as a single strip
+        for (int i = 0; i < columns;) {
+            if (row[i]) {
+                ++i;
+                continue;
+            }
+            int j = i;
+            while (j < columns && !row[j]) ++j;
+
+            MandelJob strip = job;
+            strip.viewport  = job.viewport.shifted(
+                vec2((tx0 + i) * T - gx, ty * T - gy));
+            strip.width  = (j - i) * T;
+            strip.height = T;
+            auto part = compute_escape_times(strip);
+            for (int k = i; k < j; ++k) {
+                paste(part.data() + (k - i) * T, strip.width, tx0 + k, ty);
+                std::vector<int> tile(T * T);
+                for (int y = 0; y < T; ++y) {
+                    std::copy_n(part.begin() + y * strip.width + (k - i) * T, T,
+                                tile.begin() + y * T);
+                }
+                cache.insert(key(tx0 + k, ty), std::move(tile));
+            }
+            buffers.give(std::move(part));
+            i = j;
+        }
+    }
+    return res;
+}
+
+FrameBuffer<int> MandelbrotEngine::compute_escape_times(MandelJob const& job) {
+    switch (job.algorithm) {
+    case MandelAlgorithm::DEFAULT: return calculate_iters(job);
+    case MandelAlgorithm::OPTIMIZED: return optimized_escape_times(job);
+    case MandelAlgorithm::AVX2:
+    case MandelAlgorithm::AVX512:
+    case MandelAlgorithm::HISTOGRAM:
+    case MandelAlgorithm::BLACK_AND_WHITE: {
+        LineSampler const line = line_sampler(job);
+        return job.subdivide ? subdivided_escape_times(job, line)
+                             : simd_escape_times(job, line);
+    }
+    case MandelAlgorithm::DEEP_ZOOM: return deep_zoom.escape_times(job);
+    }
+    unreachable();
+}
+
+template<class F>
+void MandelbrotEngine::run_chunks(std::span<double const> row_costs,
+                                  std::span<int const> out, F const& f) {
+    auto const chunks   = cost_balanced_chunks(row_costs, chunks_per_frame);
+    std::size_t const w = row_costs.empty() ? 0 : out.size() / row_costs.size();
+    tpool.parallel_for(0, chunks.size(), [&](int c1, int c2) {
+        for (int c = c1; c < c2; ++c) {
+            trace::Span span("rows", "engine");
+            f(chunks[c].begin, chunks[c].end);
+            if constexpr (trace::enabled) {
+                auto const rows = out.subspan(chunks[c].begin * w,
+                                              (chunks[c].end - chunks[c].begin) * w);
+                span.arg("y", chunks[c].begin);
+                span.arg("iterations", std::accumulate(rows.begin(), rows.end(), std::int64_t(0)));
+            }
+        }
+    });
+}
+
+template<class F>
+void MandelbrotEngine::paint(MandelJob const& job, std::uint8_t* data,
+                             int rowstride, PixelFormat format, F const& color_of) {
+    int const w = job.width;
+    tpool.parallel_for(0, job.height, [&](int y1, int y2) {
+        for (int y = y1; y < y2; ++y) {
+            std::uint8_t* const row = data + std::ptrdiff_t(y) * rowstride;
+            std::size_t const i     = std::size_t(y) * w;
+            // A scalar pass: one table load and one store per pixel. Rows of
+            // ARGB32 surfaces are word-aligned, so those are word stores.
+            if (format == PixelFormat::ARGB32) {
+                argb32* __restrict const px = reinterpret_cast<argb32*>(row);
+                for (int x = 0; x < w; ++x) px[x] = color_of(i + x);
+            } else {
+                for (int x = 0; x < w; ++x) write_rgb(row + 3 * x, color_of(i + x));
+            }
+        }
+    });
+}
+
+void MandelbrotEngine::colorize_hue(MandelJob const& job,
+                                    std::span<int const> iters,
+                                    std::uint8_t* data, int rowstride,
+                                    PixelFormat format) {
+    int const mx = job.max_iters;
+    if (mx > iteration_table_limit) {
+        paint(job, data, rowstride, format, [&](std::size_t i) {
+            return palette.hue(double(iters[i]) / mx);
+        });
+        return;
+    }
+
+    if (iter_colors.size() != std::size_t(mx) + 1)
+        iter_colors = PaletteLut::for_iterations(mx);
+    argb32 const* const colors = iter_colors.data();
+    paint(job, data, rowstride, format,
+          [colors, iters](std::size_t i) { return colors[iters[i]]; });
+}
+
+template<class F>
+decltype(auto) MandelbrotEngine::with_histogram_colors(MandelJob const& job,
+                                                     std::span<int const> iters,
+                                                     F const& f) {
+    std::size_t const size = iters.size();
+    assert(size == std::size_t(job.width) * job.height);
+    int const mx       = job.max_iters;
+    double const total = size;
+    // One part per worker for the passes that need private state
+    int const parts = std::clamp(tpool.size(), 1, std::max(job.height, 1));
+
+    // Each pixel gets the palette at the share of pixels escaping no later
+    // than it; color_of(n) is that colour for escape time n
+
+    if (std::size_t(mx) < size) {
+        // Dense: a histogram per part, summed and prefix-summed in slices of
+        // the escape times, then turned into colours in place
+        std::vector<std::vector<std::uint32_t>>& hist = histograms;
+        hist.resize(parts);
+        tpool.parallel_for(0, parts, [&](int p1, int p2) {
+            for (int p = p1; p < p2; ++p) {
+                hist[p].assign(mx + 1, 0);
+                for (std::size_t i = size * p / parts; i < size * (p + 1) / parts; ++i)
+                    ++hist[p][iters[i]];
+            }
+        });
+
+        std::vector<std::uint32_t>& cumulative = hist[0];
+        auto slice = [&](int s) { return int(std::int64_t(mx + 1) * s / parts); };
+        std::vector<std::uint32_t> slice_sum(parts);
+        tpool.parallel_for(0, parts, [&](int s1, int s2) {
+            for (int s = s1; s < s2; ++s) {
+                std::uint32_t sum = 0;
+                for (int v = slice(s); v < slice(s + 1); ++v) {
+                    for (int p = 1; p < parts; ++p) cumulative[v] += hist[p][v];
+                    sum           += cumulative[v];
+                    cumulative[v]  = sum;
+                }
+                slice_sum[s] = sum;
+            }
+        });
+        std::exclusive_scan(slice_sum.begin(), slice_sum.end(), slice_sum.begin(), 0u);
+        tpool.parallel_for(0, parts, [&](int s1, int s2) {
+            for (int s = s1; s < s2; ++s) {
+                for (int v = slice(s); v < slice(s + 1); ++v)
+                    cumulative[v] = palette.hue((cumulative[v] + slice_sum[s]) / total);
+            }
+        });
+
+        argb32 const* const colors = cumulative.data();
+        return f([colors](int n) { return colors[n]; });
+    }
+
+    // Sparse: max_iters beyond the pixel count would make the histogram
+    // mostly empty and possibly huge. Sort the escape times instead, in
+    // parallel parts merged pairwise, and look each pixel up among the
+    // distinct ones.
+    FrameBuffer<int> sorted = buffers.take(size);
+    std::copy(iters.begin(), iters.end(), sorted.begin());
+    auto bound = [&](int p) { return sorted.begin() + size * p / parts; };
+    tpool.parallel_for(0, parts, [&](int p1, int p2) {
+        for (int p = p1; p < p2; ++p) std::sort(bound(p), bound(p + 1));
+    });
+    for (int width = 1; width < parts; width *= 2) {
+        int const pairs = (parts + 2 * width - 1) / (2 * width);
+        tpool.parallel_for(0, pairs, [&](int q1, int q2) {
+            for (int q = q1; q < q2; ++q) {
+                int const a = 2 * width * q;
+                std::inplace_merge(bound(a), bound(std::min(a + width, parts)),
+                                   bound(std::min(a + 2 * width, parts)));
+            }
+        });
+    }
+
+    std::vector<int>& values     = histogram_values;
+    std::vector<argb32>& colors = histogram_colors;
+    values.clear();
+    colors.clear();
+    for (std::size_t i = 0; i < size; ++i) {
+        if (i + 1 < size && sorted[i + 1] == sorted[i]) continue;
+        values.push_back(sorted[i]);
+        colors.push_back(palette.hue((i + 1) / total));
+    }
+    buffers.give(std::move(sorted));
+
+    // Escape times the frame lacks take the colour of the next one, or of
+    // the last for samples escaping later than any pixel
+    return f([&](int n) {
+        auto const it = std::lower_bound(values.begin(), values.end(), n);
+        return colors[std::min<std::size_t>(it - values.begin(), colors.size() - 1)];
+    });
+}
+
+void MandelbrotEngine::colorize_histogram(MandelJob const& job,
+                                          std::span<int const> iters,
+                                          std::uint8_t* data, int rowstride,
+                                          PixelFormat format) {
+    with_histogram_colors(job, iters, [&](auto const& color_of) {
+        paint(job, data, rowstride, format,
+              [&](std::size_t i) { return color_of(iters[i]); });
+    });
+}
+
+void MandelbrotEngine::colorize_black_and_white(MandelJob const& job,
+                                                std::span<int const> iters,
+                                                std::uint8_t* data,
+                                                int rowstride,
+                                                PixelFormat format) {
+    auto const colors = parity_colors(job.max_iters);
+    paint(job, data, rowstride, format,
+          [&](std::size_t i) { return colors[iters[i] & 1]; });
+}
+
+EscapeChannels MandelbrotEngine::escape_channels(MandelJob const& requested,
+                                                 ChannelRequest const& req) {
+    MandelJob const job = resolved(requested);
+    switch (job.algorithm) {
+    case MandelAlgorithm::AVX2:
+    case MandelAlgorithm::AVX512:
+    case MandelAlgorithm::HISTOGRAM:
+    case MandelAlgorithm::BLACK_AND_WHITE: break;
+    default:
+        throw std::invalid_argument("escape channels need a SIMD algorithm");
+    }
+    if (job.precision == KernelPrecision::DOUBLE_DOUBLE)
+        throw std::invalid_argument("escape channels need a view double precision resolves");
+
+    std::size_t const size = std::size_t(job.width) * job.height;
+    EscapeChannels res;
+    LineChannels ch;
+    if (req.smooth) {
+        res.smooth.resize(size);
+        ch.smooth = res.smooth.data();
+    }
+    if (req.trap) {
+        res.trap.resize(size);
+        ch.trap      = res.trap.data();
+        vec2 const p = req.trap->point;
+        if (auto const dir = req.trap->direction) {
+            if (dir->isZero())
+                throw std::invalid_argument("orbit trap direction is zero");
+            vec2 const n = vec2(-dir->y(), dir->x()).normalized();
+            ch.trap_form = {n.x(), n.y(), -n.dot(p), 0, 0, 0};
+        } else {
+            ch.trap_form = {1, 0, -p.x(), 0, 1, -p.y()};
+        }
+    }
+    res.iters = simd_escape_times(job, line_sampler(job), ch);
+    return res;
+}
+
+void MandelbrotEngine::colorize(MandelJob const& job, EscapeChannels const& ch,
+                                std::uint8_t* data, int rowstride,
+                                PixelFormat format) {
+    if (ch.trap.empty() && ch.smooth.empty()) {
+        colorize(job, ch.iters, data, rowstride, format);
+        return;
+    }
+    double const mx = job.max_iters;
+    paint(job, data, rowstride, format, [&](std::size_t i) {
+        // Spread the distances close to the trap over most of the palette
+        double const hue = !ch.trap.empty() ? 1 - std::exp(-4.0 * ch.trap[i])
+                                            : std::clamp(ch.smooth[i] / mx, 0.0, 1.0);
+        return palette.hue(hue);
+    });
+}
+
+void MandelbrotEngine::colorize(MandelJob const& job,
+                                std::span<int const> iters,
+                                std::uint8_t* data, int rowstride,
+                                PixelFormat format) {
+    switch (job.algorithm) {
+    case MandelAlgorithm::HISTOGRAM:
+        colorize_histogram(job, iters, data, rowstride, format);
+        break;
+    case MandelAlgorithm::BLACK_AND_WHITE:
+        colorize_black_and_white(job, iters, data, rowstride, format);
+        break;
+    default: colorize_hue(job, iters, data, rowstride, format); break;
+    }
+}
+
+void MandelbrotEngine::render(MandelJob const& job, std::uint8_t* data,
+                              int rowstride, PixelFormat format) {
+    FrameBuffer<int> iters;
+    {
+        trace::Span span("compute", trace::phase);
+        iters = escape_times(job);
+    }
+    {
+        trace::Span span("colorize", trace::phase);
+        colorize(job, iters, data, rowstride, format);
+    }
+    if (job.antialias > 1) {
+        trace::Span span("antialias", trace::phase);
+        antialias(job, iters, data, rowstride, format);
+    }
+    recycle(std::move(iters));
+}
+
+void MandelbrotEngine::render_tile(MandelJob const& job, std::uint8_t* data,
+                                   int rowstride, PixelFormat format) {
+    if (job.antialias < 2) return render(job, data, rowstride, format);
+    MandelJob outer = job;
+    outer.viewport  = job.viewport.shifted({-1, -1});
+    outer.width += 2;
+    outer.height += 2;
+    int const bpp    = bytes_per_pixel(format);
+    int const stride = outer.width * bpp;
+    FrameBuffer<std::uint8_t> framed(std::size_t(stride) * outer.height);
+    render(outer, framed.data(), stride, format);
+    for (int y = 0; y < job.height; ++y) {
+        std::uint8_t const* const src = framed.data() + std::size_t(y + 1) * stride + bpp;
+        std::copy_n(src, std::size_t(job.width) * bpp, data + std::ptrdiff_t(y) * rowstride);
+    }
+}
+
+int MandelbrotEngine::antialias(MandelJob const& job, std::span<int const> iters,
+                                std::uint8_t* data, int rowstride, PixelFormat format) {
+    if (job.antialias < 2 || resolved(job).algorithm == MandelAlgorithm::DEEP_ZOOM) return 0;
+    int const mx = job.max_iters;
+    switch (job.algorithm) {
+    case MandelAlgorithm::HISTOGRAM:
+        // Rebuilt rather than left over from colorize, which may have
+        // coloured another frame since
+        return with_histogram_colors(job, iters, [&](auto const& color_of) {
+            return resample_edges(job, data, rowstride, format, color_of);
+        });
+    case MandelAlgorithm::BLACK_AND_WHITE: {
+        auto const colors = parity_colors(mx);
+        return resample_edges(job, data, rowstride, format,
+                              [colors](int n) { return colors[n & 1]; });
+    }
+    default: break;
+    }
+    if (mx > iteration_table_limit) {
+        return resample_edges(job, data, rowstride, format,
+                              [&](int n) { return palette.hue(double(n) / mx); });
+    }
+    if (iter_colors.size() != std::size_t(mx) + 1)
+        iter_colors = PaletteLut::for_iterations(mx);
+    argb32 const* const colors = iter_colors.data();
+    return resample_edges(job, data, rowstride, format,
+                          [colors](int n) { return colors[n]; });
+}
+
+template<class F>
+int MandelbrotEngine::resample_edges(MandelJob const& job, std::uint8_t* data,
+                                     int rowstride, PixelFormat format,
+                                     F const& color_of) {
+    int const w = job.width, h = job.height, k = job.antialias;
+    int const mx = job.max_iters;
+
+    // Pixels on an edge: differing from a neighbour beyond the threshold
+    std::vector<std::uint8_t> edge(std::size_t(w) * h);
+    tpool.parallel_for(0, h, [&](int y1, int y2) {
+        for (int y = y1; y < y2; ++y) {
+            std::uint8_t const* const row = data + std::ptrdiff_t(y) * rowstride;
+            for (int x = 0; x < w; ++x) {
+                argb32 const c = read_pixel(row, x, format);
+                auto differs   = [&](std::uint8_t const* r, int nx) {
+                    return color_distance(c, read_pixel(r, nx, format)) > job.antialias_threshold;
+                };
+                edge[std::size_t(y) * w + x] =
+                    (x > 0 && differs(row, x - 1)) || (x + 1 < w && differs(row, x + 1))
+                    || (y > 0 && differs(row - rowstride, x))
+                    || (y + 1 < h && differs(row + rowstride, x));
+            }
+        }
+    });
+
+    // The samples need k times the resolution of the pixels
+    MandelJob fine = job;
+    fine.viewport.scale *= k;
+    LineSampler const alg = line_sampler(fine);
+    // Marked pixels this close together share kernel calls, the unmarked
+    // ones between them being sampled and dropped
+    constexpr int bridge = 2;
+
+    // Sample row j of a pixel sits (j + 0.5) / k down it and is shifted
+    // right by (j + 0.5) / k of the sample spacing, so the k x k samples
+    // also fall in k x k distinct columns. A comb takes every stride-th
+    // sample of row j along a run of pixels, from the first.
+    struct Comb {
+        int j, first, stride;
+    };
+    // From 3 x 3 on, about a quarter of the samples come first, and only
+    // pixels where those disagree get the rest
+    std::vector<Comb> coarse, rest;
+    for (int j = 0; j < k; ++j) {
+        if (k < 3) {
+            coarse.push_back({j, 0, 1});
+        } else if (j % 2 == 0) {
+            coarse.push_back({j, 0, 2});
+            rest.push_back({j, 1, 2});
+        } else {
+            rest.push_back({j, 0, 1});
+        }
+    }
+
+    std::atomic<int> resampled = 0;
+    tpool.parallel_for(0, h, [&](int y1, int y2) {
+        std::vector<int> samples;
+        std::vector<std::uint32_t> sums(3 * w);
+        std::vector<int> counts(w);
+        std::vector<std::uint8_t> varied(w);
+        int count = 0;
+
+        for (int y = y1; y < y2; ++y) {
+            std::uint8_t* const row = data + std::ptrdiff_t(y) * rowstride;
+            std::fill(sums.begin(), sums.end(), 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            std::fill(varied.begin(), varied.end(), 0);
+
+            auto take = [&](int x0, int x1, Comb const& c) {
+                int const n = ((x1 - x0) * k - c.first + c.stride - 1) / c.stride;
+                samples.resize(n);
+                // In samples from the top left
+                alg(samples.data(), x0 * k + c.first + (c.j + 0.5) / k, y * k + c.j + 0.5,
+                    c.stride, n, mx);
+                for (int q = 0; q < n; ++q) {
+                    int const x    = x0 + (c.first + q * c.stride) / k;
+                    argb32 const v = color_of(samples[q]);
+                    sums[3 * x]     += v >> 16 & 0xff;
+                    sums[3 * x + 1] += v >> 8 & 0xff;
+                    sums[3 * x + 2] += v & 0xff;
+                    ++counts[x];
+                    varied[x] |= color_distance(v, read_pixel(row, x, format))
+                                 > job.antialias_threshold;
+                }
+            };
+            // Runs of the pixels marked in `mark`, bridging short gaps
+            auto for_runs = [&](auto const& mark, auto const& f) {
+                for (int x0 = 0; x0 < w;) {
+                    if (!mark(x0)) {
+                        ++x0;
+                        continue;
+                    }
+                    int x1 = x0 + 1;  // past the last marked pixel of the run
+                    for (int x = x1; x < w && x - x1 < bridge; ++x) {
+                        if (mark(x)) x1 = x + 1;
+                    }
+                    f(x0, x1);
+                    x0 = x1;
+                }
+            };
+
+            std::uint8_t const* const on_edge = edge.data() + std::size_t(y) * w;
+            for_runs([&](int x) { return on_edge[x]; }, [&](int x0, int x1) {
+                for (Comb const& c : coarse) take(x0, x1, c);
+            });
+            for_runs([&](int x) { return on_edge[x] && varied[x]; }, [&](int x0, int x1) {
+                for (Comb const& c : rest) take(x0, x1, c);
+            });
+
+            for (int x = 0; x < w; ++x) {
+                if (!on_edge[x]) continue;
+                std::uint32_t const* p = &sums[3 * x];
+                std::uint32_t const n  = counts[x];
+                auto mean = [&](int c) { return (p[c] + n / 2) / n; };
+                write_pixel(row, x, 0xff000000u | mean(0) << 16 | mean(1) << 8 | mean(2),
+                            format);
+                ++count;
+            }
+        }
+        resampled.fetch_add(count);
+    });
+    return resampled;
+}
@@ -3,37 +3,39 @@
 #include <chrono>
 #include <iostream>
 
-const std::vector<RGB> NewtonFractal::root_colors = {
-    {255, 0,   0  },
-    {0,   255, 0  },
-    {0,   0,   255},
-    {255, 255, 0  },
-    {255, 0,   255},
-    {0,   255, 255},
-    {128, 255, 0  },
-    {255, 128, 0  },
-    {0,   255, 128},
-    {128, 0,   255}
-};
-
 void NewtonFractal::change_polynomial(math::Polynomial nw) {
     polynomial = nw;
     derivative = math::derivative(polynomial);
     roots      = math::find_roots(polynomial, 1e-10);
-    if (static_cast<size_t>(polynomial.degree()) > root_colors.size())
+    if (static_cast<size_t>(polynomial.degree()) > NewtonEngine::root_colors.size())
         throw std::logic_error("Polynomial degree too big, not enough colors "
-                               "in NewtonFractal::root_colors");
-    dw.queue_draw();
+                               "in NewtonEngine::root_colors");
+    request_render();
 }
 
 void NewtonFractal::change_root() {
     polynomial = math::Polynomial::from_roots(roots);
     derivative = math::derivative(polynomial);
+    request_render();
+}
+
+void NewtonFractal::request_render() {
+    int const w = dw.get_width();
+    int const h = dw.get_height();
+    if (w > 0 && h > 0) renderer.request(make_job(w, h));
     dw.queue_draw();
 }
 
-void NewtonFractal::on_resize(int w, int h) {
-    pixbuf = Gdk::Pixbuf::create(Gdk::Colorspace::RGB, false, 8, w, h);
+void NewtonFractal::on_frame_ready() {
+    renderer.consume([this](RenderedFrame const& frame) {
+        update_surface(frame_surface, frame);
+        shown_viewport = frame.viewport;
+        render_time    = frame.complete ? std::optional(frame.render_ms)
+                                        : std::nullopt;
+        frame_started_ns = frame.started_ns;
+        render_error     = frame.error;
+    });
+    dw.queue_draw();
 }
 
 void NewtonFractal::on_input_polynomial_pressed() {
@@ -70,68 +72,16 @@ void NewtonFractal::on_dialog_ok_pressed() {
     polynomial_input_dialog.hide();
 }
 
-std::vector<NewtonFractal::point> NewtonFractal::simple_alg(int w, int h) {
-    std::vector<point> data(w * h);
-
-    const vec2 tl      = movement.get_top_left();
-    const vec2 br      = movement.get_bottom_right();
-    const vec2 sz      = br - tl;
-    double const ystep = sz.y() / h;
-    double const xstep = sz.x() / w;
-    double const x1    = tl.x();
-
-    auto run_line = [this, &xstep, &x1, &w](double y1, point* data) {
-        for (int i = 0; i < w; ++i) {
-            double x = x1 + xstep * i;
-            std::complex zn(x, y1);
-
-            int iter     = 0;
-            const int mx = max_iters.get_value_as_int();
-            for (; iter < mx; ++iter) {
-                zn -= polynomial(zn) / derivative(zn);
-                for (size_t r = 0; r < roots.size(); ++r) {
-                    if (is_near(roots[r], zn)) {
-                        data[i] = point{.iterations = iter, .root = static_cast<int>(r)};
-                        goto break_out_of_iter_loop;
-                    }
-                }
-            }
-            data[i] = point{.iterations = iter, .root = -1};
-
-        break_out_of_iter_loop:;
-        }
-    };
-    auto run_lines = [&](int first, int last) {
-        for (; first != last; ++first) {
-            const double y = tl.y() + ystep * first;
-            run_line(y, data.data() + first * w);
-        }
+NewtonJob NewtonFractal::make_job(int w, int h) const {
+    return NewtonJob{
+        .viewport   = movement.get_viewport(),
+        .width      = w,
+        .height     = h,
+        .max_iters  = max_iters.get_value_as_int(),
+        .polynomial = polynomial,
+        .derivative = derivative,
+        .roots      = roots,
     };
-
-    constexpr int threads_count = 32;
-    int const dy                = h / threads_count;
-    std::vector<std::future<void>> fts;
-    fts.reserve(threads_count);
-    for (int j = 0; j < h; j += dy) {
-        fts.push_back(tpool.queue(run_lines, j, std::min(j + dy, h)));
-    }
-    for (auto& f : fts) f.get();
-
-    return data;
-}
-
-void NewtonFractal::render_color(std::vector<point> const& pts) {
-    guint8* data = pixbuf->get_pixels();
-
-    for (size_t i = 0; i < pts.size(); ++i) {
-        int r           = pts[i].root;
-        double const mx = max_iters.get_value();
-        double mult     = 0.2 + 0.8 * (mx - pts[i].iterations) / mx;
-        RGB c           = (r == -1) ? RGB(0, 0, 0) : root_colors[r] * mult;
-        data[3 * i]     = c[0];
-        data[3 * i + 1] = c[1];
-        data[3 * i + 2] = c[2];
-    }
 }
 
 std::vector<vec2> NewtonFractal::generate_path(math::complex const& z_) {
@@ -151,27 +101,9 @@ std::vector<vec2> NewtonFractal::generate_path(math::complex const& z_) {
     return path;
 }
 
-bool NewtonFractal::is_near(std::complex<double> const& a,
-                            std::complex<double> const& b) const {
-    constexpr double tol = 0.00001;
-    double const d       = std::norm(a - b);
-    return d < tol;
-}
-
-void NewtonFractal::on_draw(Cairo::RefPtr<Cairo::Context> const& cr, int w,
-                            int h) {
-
-    auto t1                   = std::chrono::steady_clock::now();
-    std::vector<point> points = simple_alg(w, h);
-    render_color(points);
-    auto t2 = std::chrono::steady_clock::now();
-    auto et =
-        std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
-            t2 - t1);
-
-    Gdk::Cairo::set_source_pixbuf(cr, pixbuf);
-    cr->rectangle(0, 0, w, h);
-    cr->fill();
+void NewtonFractal::on_draw(Cairo::RefPtr<Cairo::Context> const& cr, int,
+                            int) {
+    paint_frame(cr, frame_surface, shown_viewport, movement.get_viewport());
 
     for (auto& root : roots) {
         cr->set_source_rgb(255, 255, 255);
@@ -194,7 +126,12 @@ void NewtonFractal::on_draw(Cairo::RefPtr<Cairo::Context> const& cr, int w,
     }
 
     const Glib::ustring str =
-        "Render time: " + std::to_string(et.count()) + " ms";
+        (!render_error.empty() ? "Render failed: " + render_error
+         : render_time         ? "Render time: " + std::to_string(*render_time) + " ms"
+                               : std::string("Rendering..."))
+        + (show_stats.get_active() && render_time
+               ? "\n" + frame_stats_text(frame_started_ns, *render_time)
+               : std::string());
     auto layout = dw.create_pango_layout(str);
     layout->set_font_description(font);
 
@@ -235,8 +172,10 @@ void NewtonFractal::on_mouse_moved(double x, double y) {
     }
 }
 
-NewtonFractal::NewtonFractal(): movement(dw) {
-    dw.signal_resize().connect([this](int w, int h) { on_resize(w, h); });
+NewtonFractal::NewtonFractal()
+    : movement(dw), renderer(ThreadPool::shared(), [this] { frame_ready.emit(); }) {
+    frame_ready.connect(sigc::mem_fun(*this, &NewtonFractal::on_frame_ready));
+    dw.signal_resize().connect([this](int, int) { request_render(); });
     dw.set_draw_func(sigc::mem_fun(*this, &NewtonFractal::on_draw));
     dw.set_content_height(500);
     dw.set_content_width(500);
@@ -251,13 +190,14 @@ NewtonFractal::NewtonFractal(): movement(dw) {
     options.append(show_path);
     options.append(draw_axis);
     options.append(input_polynomial);
+    if (trace::enabled) options.append(show_stats);
 
     max_iters.set_increments(1, 0);
     max_iters.set_snap_to_ticks();
     max_iters.set_range(1, std::numeric_limits<int>::max());
     max_iters.set_numeric();
     max_iters.set_value(30);
-    max_iters.signal_value_changed().connect([this] { dw.queue_draw(); });
+    max_iters.signal_value_changed().connect([this] { request_render(); });
 
     show_path.set_active(false);
     show_path.signal_toggled().connect([this] { dw.queue_draw(); });
@@ -267,6 +207,10 @@ NewtonFractal::NewtonFractal(): movement(dw) {
     draw_axis.set_label("Draw axes");
     draw_axis.signal_toggled().connect([this] { dw.queue_draw(); });
 
+    show_stats.set_label("Show frame stats");
+    show_stats.set_active(false);
+    show_stats.signal_toggled().connect([this] { dw.queue_draw(); });
+
     input_polynomial.set_label("Input polynomial");
     input_polynomial.signal_clicked().connect(
         [this] { on_input_polynomial_pressed(); });
@@ -305,7 +249,7 @@ NewtonFractal::NewtonFractal(): movement(dw) {
 
     movement.signal_mouse_moved().connect(
         sigc::mem_fun(*this, &NewtonFractal::on_mouse_moved));
-    movement.signal_changed().connect([this] { dw.queue_draw(); });
+    movement.signal_changed().connect([this] { request_render(); });
     movement.signal_mouse_clicked().connect(
         [this](auto x) { on_mouse_click(x); });
 
@@ -0,0 +1,142 @@
+#include <newton_engine.hpp>
+
+
+const std::vector<RGB> NewtonEngine::root_colors = {
+    {255, 0,   0  },
+    {0,   255, 0  },
+    {0,   0,   255},
+    {255, 255, 0  },
+    {255, 0,   255},
+    {0,   255, 255},
+    {128, 255, 0  },
+    {255, 128, 0  },
+    {0,   255, 128},
+    {128, 0,   255}
+};
+
+bool NewtonEngine::is_near(math::complex const& a, math::complex const& b) {
+    constexpr double tol = 0.00001;
+    double const d       = std::norm(a - b);
+    return d < tol;
+}
+
+std::optional<vec2i> NewtonEngine::reusable_shift(NewtonJob const& job) const {
+    if (!last_job || last_job->width != job.width
+        || last_job->height != job.height
+        || last_job->max_iters != job.max_iters
+        || last_job->polynomial != job.polynomial
+        || last_job->roots != job.roots)
+        return std::nullopt;
+    return pixel_shift(last_job->viewport, job.viewport, job.width, job.height);
+}
+
+FrameBuffer<NewtonEngine::point> NewtonEngine::escape_times(
+    NewtonJob const& job, RenderControl<point> const& ctl) {
+    auto res = render_frame(last_points, buffers, job.width, job.height,
+                            reusable_shift(job), ctl,
+                            [&](int x, int y, int w, int h) {
+                                NewtonJob strip = job;
+                                strip.viewport  = job.viewport.shifted({x, y});
+                                strip.width     = w;
+                                strip.height    = h;
+                                return compute_escape_times(strip);
+                            });
+
+    // Keep a copy for the next pan in a recycled buffer
+    FrameBuffer<point> kept = buffers.take(res.size());
+    std::copy(res.begin(), res.end(), kept.begin());
+    buffers.give(std::exchange(last_points, std::move(kept)));
+    last_job = job;
+    return res;
+}
+
+FrameBuffer<NewtonEngine::point> NewtonEngine::compute_escape_times(NewtonJob const& job) {
+    int const w = job.width;
+    int const h = job.height;
+    FrameBuffer<point> data = buffers.take(std::size_t(w) * h);
+
+    const vec2 tl      = job.viewport.top_left;
+    double const ystep = job.viewport.pixel_size();
+    double const xstep = job.viewport.pixel_size();
+    double const x1    = tl.x();
+    int const mx       = job.max_iters;
+
+    // Every xstride-th pixel of a line, the first count of them
+    auto run_line = [&job, xstep, x1, mx](double y1, point* data, int xstride,
+                                          int count) {
+        for (int i = 0; i < count; ++i) {
+            double x = x1 + xstep * xstride * i;
+            std::complex zn(x, y1);
+
+            int iter = 0;
+            for (; iter < mx; ++iter) {
+                zn -= job.polynomial(zn) / job.derivative(zn);
+                for (size_t r = 0; r < job.roots.size(); ++r) {
+                    if (is_near(job.roots[r], zn)) {
+                        data[i] = point{.iterations = iter, .root = static_cast<int>(r)};
+                        goto break_out_of_iter_loop;
+                    }
+                }
+            }
+            data[i] = point{.iterations = iter, .root = -1};
+
+        break_out_of_iter_loop:;
+        }
+    };
+    auto run_lines = [&](int first, int last) {
+        for (; first != last; ++first) {
+            const double y = tl.y() + ystep * first;
+            run_line(y, data.data() + first * w, 1, w);
+        }
+    };
+
+    auto const costs = probe_row_costs<point>(tpool, w, h, [&](int y, std::span<point> line) {
+        run_line(tl.y() + ystep * y, line.data(), probe_step, line.size());
+    });
+    auto const chunks = cost_balanced_chunks(costs, chunks_per_frame);
+    tpool.parallel_for(0, chunks.size(), [&](int c1, int c2) {
+        for (int c = c1; c < c2; ++c) {
+            trace::Span span("rows", "engine");
+            run_lines(chunks[c].begin, chunks[c].end);
+            if constexpr (trace::enabled) {
+                std::int64_t iters = 0;
+                for (int y = chunks[c].begin; y < chunks[c].end; ++y) {
+                    for (int x = 0; x < w; ++x) iters += data[std::size_t(y) * w + x].iterations;
+                }
+                span.arg("y", chunks[c].begin);
+                span.arg("iterations", iters);
+            }
+        }
+    });
+
+    return data;
+}
+
+void NewtonEngine::colorize(NewtonJob const& job, std::span<point const> pts,
+                            std::uint8_t* data, int rowstride,
+                            PixelFormat format) const {
+    double const mx = job.max_iters;
+    for (int y = 0; y < job.height; ++y) {
+        std::uint8_t* row = data + y * rowstride;
+        for (int x = 0; x < job.width; ++x) {
+            point const& p = pts[y * job.width + x];
+            double mult    = 0.2 + 0.8 * (mx - p.iterations) / mx;
+            RGB c = (p.root == -1) ? RGB(0, 0, 0) : root_colors[p.root] * mult;
+            write_pixel(row, x, pack_argb(c), format);
+        }
+    }
+}
+
+void NewtonEngine::render(NewtonJob const& job, std::uint8_t* data,
+                          int rowstride, PixelFormat format) {
+    FrameBuffer<point> pts;
+    {
+        trace::Span span("compute", trace::phase);
+        pts = escape_times(job);
+    }
+    {
+        trace::Span span("colorize", trace::phase);
+        colorize(job, pts, data, rowstride, format);
+    }
+    recycle(std::move(pts));
+}
@@ -0,0 +1,16 @@
+#include <palette.hpp>
+
+PaletteLut::PaletteLut(): by_hue(hue_steps) {
+    Palette p;
+    for (int i = 0; i < hue_steps; ++i) {
+        by_hue[i] = pack_argb(p[double(i) / (hue_steps - 1)]);
+    }
+}
+
+std::vector<argb32> PaletteLut::for_iterations(int max_iters) {
+    Palette p;
+    std::vector<argb32> res(max_iters + 1);
+    double const mx = max_iters;
+    for (int n = 0; n <= max_iters; ++n) res[n] = pack_argb(p[n / mx]);
+    return res;
+}
@@ -0,0 +1,49 @@
+#include <partition.hpp>
+
+#include <numeric>
+
+std::vector<RowChunk> cost_balanced_chunks(std::span<double const> costs, int count) {
+    int const h = costs.size();
+    std::vector<RowChunk> chunks;
+    if (h == 0) return chunks;
+    count = std::clamp(count, 1, h);
+
+    double const total = std::accumulate(costs.begin(), costs.end(), 0.0);
+    if (!(total > 0)) {
+        // Nothing to go by, cut evenly
+        for (int i = 0; i < count; ++i) {
+            chunks.push_back({h * i / count, h * (i + 1) / count, 0});
+        }
+        return chunks;
+    }
+
+    // Cut where the running cost passes each multiple of total / count,
+    // on whichever side of the row that crosses it is closer
+    double const target = total / count;
+    double done         = 0;
+    int begin           = 0;
+    double cost         = 0;
+    for (int y = 0; y < h; ++y) {
+        double const next = done + costs[y];
+        double const cut  = target * (chunks.size() + 1);
+        if (next >= cut && int(chunks.size()) < count - 1) {
+            if (next - cut <= cut - done || y == begin) {
+                chunks.push_back({begin, y + 1, cost + costs[y]});
+                begin = y + 1;
+                cost  = 0;
+            } else {
+                chunks.push_back({begin, y, cost});
+                begin = y;
+                cost  = costs[y];
+            }
+        } else {
+            cost += costs[y];
+        }
+        done = next;
+    }
+    if (begin < h) chunks.push_back({begin, h, cost});
+
+    std::stable_sort(chunks.begin(), chunks.end(),
+                     [](RowChunk const& a, RowChunk const& b) { return a.cost > b.cost; });
+    return chunks;
+}
@@ -0,0 +1,197 @@
+#include <perturbation.hpp>
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+/// A pixel is glitched once |z|^2 < glitch_tolerance * |Z|^2: its offset
+/// then carries fewer significant bits than the image needs
+constexpr double glitch_tolerance = 1e-6;
+/// Maximum relative error of the series against the probe orbits
+constexpr double series_tolerance = 1e-7;
+
+bool is_finite(math::complex const& c) {
+    return std::isfinite(c.real()) && std::isfinite(c.imag());
+}
+
+}  // namespace
+
+auto PerturbationEngine::reference_orbit(PrecisePoint const& c, int max_iters)
+    -> std::vector<OrbitPoint> {
+    unsigned const bits = std::max(c.x.get_prec(), c.y.get_prec());
+    mpf_class x(0, bits), y(0, bits), x2(0, bits), y2(0, bits), xy(0, bits);
+
+    std::vector<OrbitPoint> orbit;
+    orbit.reserve(std::min(max_iters, 1 << 20) + 1);
+    for (int n = 0;; ++n) {
+        double const re = x.get_d();
+        double const im = y.get_d();
+        double const r2 = re * re + im * im;
+        orbit.push_back({re, im, glitch_tolerance * r2});
+        if (n == max_iters || r2 > 4) break;
+
+        xy = x * y;
+        y  = xy + xy + c.y;
+        x  = x2 - y2 + c.x;
+        x2 = x * x;
+        y2 = y * y;
+    }
+    return orbit;
+}
+
+auto PerturbationEngine::series_approximation(
+    std::vector<OrbitPoint> const& orbit,
+    std::vector<math::complex> const& probes, int max_iters) -> Series {
+    using math::complex;
+
+    Series s;
+    complex a = 0, b = 0, c = 0;
+    std::vector<complex> dz(probes.size(), 0.0);
+
+    int const last = std::min<int>(orbit.size() - 1, max_iters);
+    for (int n = 0; n < last; ++n) {
+        complex const Z2 = 2.0 * complex{orbit[n].re, orbit[n].im};
+        complex const na = Z2 * a + 1.0;
+        complex const nb = Z2 * b + a * a;
+        complex const nc = Z2 * c + 2.0 * a * b;
+        if (!is_finite(na) || !is_finite(nb) || !is_finite(nc)) break;
+
+        complex const Zn{orbit[n + 1].re, orbit[n + 1].im};
+        bool valid = true;
+        for (size_t p = 0; p < probes.size() && valid; ++p) {
+            complex const d = probes[p];
+            dz[p]           = (Z2 + dz[p]) * dz[p] + d;
+
+            complex const approx = ((nc * d + nb) * d + na) * d;
+            valid = std::abs(approx - dz[p]) <= series_tolerance * std::abs(dz[p])
+                 && std::norm(Zn + dz[p]) <= 4;
+        }
+        if (!valid) break;
+
+        a      = na;
+        b      = nb;
+        c      = nc;
+        s.skip = n + 1;
+    }
+    s.a = a;
+    s.b = b;
+    s.c = c;
+    return s;
+}
+
+void PerturbationEngine::render_pixels(MandelJob const& job,
+                                       vec2 const& ref_pixel,
+                                       std::vector<int> const& pixels,
+                                       FrameBuffer<int>& out,
+                                       std::vector<Glitch>& glitches) {
+    int const w       = job.width;
+    int const mx      = job.max_iters;
+    double const step = job.viewport.pixel_size();
+
+    auto const orbit = reference_orbit(
+        job.viewport.precise_screen_to_world(ref_pixel), mx);
+    int const orbit_len = orbit.size();
+
+    auto delta_c = [&](int idx) {
+        return math::complex{(idx % w - ref_pixel.x()) * step,
+                             (idx / w - ref_pixel.y()) * step};
+    };
+
+    // Probe the corners of the rendered area to validate the series
+    int x1 = w, y1 = job.height, x2 = 0, y2 = 0;
+    for (int idx : pixels) {
+        x1 = std::min(x1, idx % w);
+        x2 = std::max(x2, idx % w);
+        y1 = std::min(y1, idx / w);
+        y2 = std::max(y2, idx / w);
+    }
+    std::vector<math::complex> probes;
+    for (int y : {y1, y2})
+        for (int x : {x1, x2})
+            if (vec2(x, y) != ref_pixel) probes.push_back(delta_c(y * w + x));
+    Series const series = series_approximation(orbit, probes, mx);
+    if (stats.references == 0) stats.skipped_iters = series.skip;
+
+    auto run = [&](int first, int last) {
+        std::vector<Glitch> found;
+        for (int k = first; k < last; ++k) {
+            int const idx          = pixels[k];
+            math::complex const dc = delta_c(idx);
+            double const dcr = dc.real(), dci = dc.imag();
+
+            math::complex dz = ((series.c * dc + series.b) * dc + series.a) * dc;
+            double zr = dz.real(), zi = dz.imag();
+            double ratio = -1;
+
+            int n = series.skip;
+            for (; n < mx; ++n) {
+                if (n >= orbit_len) {
+                    // Reference escaped before this pixel
+                    ratio = 1;
+                    break;
+                }
+                OrbitPoint const& Z = orbit[n];
+                double const xr     = Z.re + zr;
+                double const xi     = Z.im + zi;
+                double const r2     = xr * xr + xi * xi;
+                if (r2 > 4) break;
+                if (r2 < Z.glitch_r2) {
+                    ratio = r2 * glitch_tolerance / Z.glitch_r2;
+                    break;
+                }
+                double const tr = Z.re + Z.re + zr;
+                double const ti = Z.im + Z.im + zi;
+                double const nr = tr * zr - ti * zi + dcr;
+                zi              = tr * zi + ti * zr + dci;
+                zr              = nr;
+            }
+            out[idx] = n;
+            if (ratio >= 0) found.push_back({idx, ratio});
+        }
+        return found;
+    };
+
+    int const count  = pixels.size();
+    int const chunk  = std::max(count / 256, 64);
+    int const chunks = (count + chunk - 1) / chunk;
+    // Glitches per chunk, gathered in pixel order
+    std::vector<std::vector<Glitch>> found(chunks);
+    tpool.parallel_for(0, chunks, [&](int c1, int c2) {
+        for (int c = c1; c < c2; ++c)
+            found[c] = run(c * chunk, std::min((c + 1) * chunk, count));
+    });
+
+    glitches.clear();
+    for (auto const& f : found) glitches.insert(glitches.end(), f.begin(), f.end());
+}
+
+FrameBuffer<int> PerturbationEngine::escape_times(MandelJob const& job) {
+    int const w = job.width;
+    int const h = job.height;
+    auto out = untouched_buffer<int>(std::size_t(w) * h);
+    stats = {};
+    if (out.empty()) return out;
+
+    std::vector<int> pixels(w * h);
+    std::iota(pixels.begin(), pixels.end(), 0);
+    vec2 ref_pixel{w / 2, h / 2};
+
+    std::vector<Glitch> glitches;
+    while (true) {
+        render_pixels(job, ref_pixel, pixels, out, glitches);
+        ++stats.references;
+        if (glitches.empty() || stats.references == max_references) break;
+
+        // The most glitched pixel is closest to the feature the current
+        // reference could not resolve
+        auto const best = std::ranges::min_element(glitches, {}, &Glitch::ratio);
+        ref_pixel       = {best->index % w, best->index / w};
+
+        pixels.clear();
+        for (auto const& g : glitches) pixels.push_back(g.index);
+    }
+    stats.glitched_pixels = glitches.size();
+
+    return out;
+}
@@ -0,0 +1,469 @@
+#include <animation.hpp>
+#include <mandel_engine.hpp>
+#include <newton_engine.hpp>
+#include <tiled_export.hpp>
+
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+constexpr char const* usage = R"(Usage: fractal-render [options]
+  --fractal mandelbrot|newton   fractal to render (default mandelbrot)
+  --size WxH                    image size in pixels (default 1920x1080)
+  --center X,Y                  world coordinates of the image centre, any
+                                number of digits
+  --scale S                     pixels per world unit (default width / 4)
+  --iters N                     maximum iterations (default 256)
+  --algorithm NAME              default|histogram|optimized|avx2|avx512|bw|deep
+  --subdivide                   skip areas enclosed by a uniform border
+  --precision auto|float|double|double-double
+                                arithmetic of the SIMD kernels (default auto:
+                                the narrowest that resolves the pixels)
+  --smooth                      colour by continuous escape time, SIMD only
+  --aa N                        anti-alias edges with N x N samples per pixel,
+                                re-sampling only pixels that differ from a
+                                neighbour (default 1: off)
+  --aa-threshold T              colour difference, summed over red, green and
+                                blue, that marks an edge (default 48)
+  --trap X,Y[,DX,DY]            colour by the orbits' distance to a point, or
+                                to a line along DX,DY, SIMD only
+  --poly C0,C1,...              real polynomial coefficients for newton
+  --threads N                   worker threads (default: all cores)
+  --pin                         pin each worker thread to a core, spreading
+                                them over the NUMA nodes
+  --trace FILE                  write a Chrome trace of the render, in builds
+                                configured with -DENABLE_TRACING=ON
+  --keyframes FILE              render the zoom animation FILE describes, one
+                                keyframe per line as FRAME X Y SCALE ITERS;
+                                --center, --scale and --iters are ignored
+  --fps N                       frame rate of Y4M animations (default 30)
+  --tile N                      tile size of .tif output (default 512)
+  -o FILE                       output PPM file, '-' for stdout (default out.ppm).
+                                Animations go to numbered PNG or PPM files,
+                                the digits replacing a run of '#' (default
+                                frame_#####.ppm), or to a Y4M stream: '-' or
+                                a .y4m file. A .tif file is rendered tile by
+                                tile as a tiled BigTIFF, in memory independent
+                                of its size; rerunning an interrupted render
+                                resumes it
+)";
+
+struct Options {
+    bool newton = false;
+    int width   = 1920;
+    int height  = 1080;
+    std::string center_x = "-0.5", center_y = "0";
+    double scale = 0;
+    int iters    = 256;
+    MandelAlgorithm algorithm = MandelAlgorithm::AVX2;
+    bool subdivide = false;
+    KernelPrecision precision = KernelPrecision::AUTO;
+    ChannelRequest channels;
+    int antialias           = 1;
+    int antialias_threshold = 48;
+    std::vector<math::complex> poly = {-1, 0, 0, 1};
+    int threads = cpu_topology().cpu_count();
+    bool pin    = false;
+    std::string trace_file;
+    std::string keyframes;
+    int fps            = 30;
+    int tile           = 512;
+    std::string output = "out.ppm";
+};
+
+template<class T>
+T parse_number(std::string_view s) {
+    T v{};
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (ec != std::errc{} || end != s.data() + s.size())
+        throw std::invalid_argument("invalid number '" + std::string(s) + "'");
+    return v;
+}
+
+std::vector<double> parse_list(std::string_view s, char sep) {
+    std::vector<double> res;
+    for (size_t pos = 0;;) {
+        size_t next = s.find(sep, pos);
+        res.push_back(parse_number<double>(s.substr(pos, next - pos)));
+        if (next == std::string_view::npos) break;
+        pos = next + 1;
+    }
+    return res;
+}
+
+MandelAlgorithm parse_algorithm(std::string_view s) {
+    if (s == "default") return MandelAlgorithm::DEFAULT;
+    if (s == "histogram") return MandelAlgorithm::HISTOGRAM;
+    if (s == "optimized") return MandelAlgorithm::OPTIMIZED;
+    if (s == "avx2") return MandelAlgorithm::AVX2;
+    if (s == "avx512") return MandelAlgorithm::AVX512;
+    if (s == "bw") return MandelAlgorithm::BLACK_AND_WHITE;
+    if (s == "deep") return MandelAlgorithm::DEEP_ZOOM;
+    throw std::invalid_argument("unknown algorithm '" + std::string(s) + "'");
+}
+
+KernelPrecision parse_precision(std::string_view s) {
+    if (s == "auto") return KernelPrecision::AUTO;
+    if (s == "double") return KernelPrecision::DOUBLE;
+    if (s == "float") return KernelPrecision::SINGLE;
+    if (s == "double-double") return KernelPrecision::DOUBLE_DOUBLE;
+    throw std::invalid_argument("unknown precision '" + std::string(s) + "'");
+}
+
+bool tiled_output(Options const& op) {
+    return op.output.ends_with(".tif") || op.output.ends_with(".tiff");
+}
+
+Options parse_options(int argc, char** argv) {
+    Options op;
+    bool center_set = false, output_set = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto value           = [&]() -> std::string_view {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("missing value for "
+                                            + std::string(arg));
+            return argv[++i];
+        };
+
+        if (arg == "--fractal") {
+            auto v = value();
+            if (v != "mandelbrot" && v != "newton")
+                throw std::invalid_argument("unknown fractal '"
+                                            + std::string(v) + "'");
+            op.newton = v == "newton";
+        } else if (arg == "--size") {
+            auto v   = value();
+            auto sep = v.find('x');
+            op.width  = parse_number<int>(v.substr(0, sep));
+            op.height = parse_number<int>(
+                sep == std::string_view::npos ? "" : v.substr(sep + 1));
+        } else if (arg == "--center") {
+            auto v   = value();
+            auto sep = v.find(',');
+            if (sep == std::string_view::npos)
+                throw std::invalid_argument("--center expects X,Y");
+            op.center_x = v.substr(0, sep);
+            op.center_y = v.substr(sep + 1);
+            center_set  = true;
+        } else if (arg == "--scale") {
+            op.scale = parse_number<double>(value());
+        } else if (arg == "--iters") {
+            op.iters = parse_number<int>(value());
+        } else if (arg == "--algorithm") {
+            op.algorithm = parse_algorithm(value());
+        } else if (arg == "--subdivide") {
+            op.subdivide = true;
+        } else if (arg == "--aa") {
+            op.antialias = parse_number<int>(value());
+        } else if (arg == "--aa-threshold") {
+            op.antialias_threshold = parse_number<int>(value());
+        } else if (arg == "--smooth") {
+            op.channels.smooth = true;
+        } else if (arg == "--trap") {
+            auto const v = parse_list(value(), ',');
+            if (v.size() != 2 && v.size() != 4)
+                throw std::invalid_argument("--trap expects X,Y or X,Y,DX,DY");
+            op.channels.trap = OrbitTrap{.point = {v[0], v[1]}};
+            if (v.size() == 4) op.channels.trap->direction = vec2{v[2], v[3]};
+        } else if (arg == "--precision") {
+            op.precision = parse_precision(value());
+        } else if (arg == "--poly") {
+            auto v = parse_list(value(), ',');
+            op.poly.assign(v.begin(), v.end());
+        } else if (arg == "--threads") {
+            op.threads = parse_number<int>(value());
+        } else if (arg == "--pin") {
+            op.pin = true;
+        } else if (arg == "--trace") {
+            if (!trace::enabled)
+                throw std::invalid_argument("--trace needs a build with tracing enabled");
+            op.trace_file = value();
+        } else if (arg == "--keyframes") {
+            op.keyframes = value();
+        } else if (arg == "--fps") {
+            op.fps = parse_number<int>(value());
+        } else if (arg == "--tile") {
+            op.tile = parse_number<int>(value());
+        } else if (arg == "-o") {
+            op.output  = value();
+            output_set = true;
+        } else if (arg == "-h" || arg == "--help") {
+            std::cout << usage;
+            std::exit(0);
+        } else {
+            throw std::invalid_argument("unknown option " + std::string(arg));
+        }
+    }
+
+    if (op.width <= 0 || op.height <= 0)
+        throw std::invalid_argument("image size must be positive");
+    if (op.iters <= 0) throw std::invalid_argument("--iters must be positive");
+    if (op.threads <= 0)
+        throw std::invalid_argument("--threads must be positive");
+    if (op.newton && !center_set) op.center_x = op.center_y = "0";
+    if (op.scale == 0) op.scale = op.width / 4.0;
+    if (op.scale < 0) throw std::invalid_argument("--scale must be positive");
+    if (op.antialias < 1 || op.antialias > 16)
+        throw std::invalid_argument("--aa takes 1 to 16 samples per side");
+    if (op.antialias > 1 && (op.channels.smooth || op.channels.trap))
+        throw std::invalid_argument("--aa works with escape-time colouring only");
+    if (!op.keyframes.empty()) {
+        if (op.channels.smooth || op.channels.trap)
+            throw std::invalid_argument("--smooth and --trap are for single images");
+        if (!output_set) op.output = "frame_#####.ppm";
+    } else if (tiled_output(op) && !op.newton
+               && op.algorithm == MandelAlgorithm::HISTOGRAM) {
+        throw std::invalid_argument("histogram colouring needs the whole image at once");
+    }
+    return op;
+}
+
+MandelJob mandel_job(Options const& op, Viewport const& view, int max_iters) {
+    return MandelJob{
+        .viewport            = view,
+        .width               = op.width,
+        .height              = op.height,
+        .max_iters           = max_iters,
+        .algorithm           = op.algorithm,
+        .subdivide           = op.subdivide,
+        .precision           = op.precision,
+        .antialias           = op.antialias,
+        .antialias_threshold = op.antialias_threshold,
+    };
+}
+
+NewtonJob newton_job(Options const& op, Viewport const& view, int max_iters) {
+    math::Polynomial p(op.poly);
+    NewtonJob job{
+        .viewport   = view,
+        .width      = op.width,
+        .height     = op.height,
+        .max_iters  = max_iters,
+        .polynomial = p,
+        .derivative = math::derivative(p),
+        .roots      = math::find_roots(p, 1e-10),
+    };
+    if (job.roots.size() > NewtonEngine::root_colors.size())
+        throw std::invalid_argument("polynomial degree too big");
+    return job;
+}
+
+/// Compute and colour a Mandelbrot image as the options ask, or a `tile`
+/// of a larger one
+void render_mandel(MandelbrotEngine& engine, Options const& op, MandelJob const& job,
+                   std::uint8_t* rgb, int rowstride, bool tile = false) {
+    if (op.channels.smooth || op.channels.trap) {
+        engine.colorize(job, engine.escape_channels(job, op.channels), rgb, rowstride);
+    } else if (tile) {
+        engine.render_tile(job, rgb, rowstride);
+    } else {
+        engine.render(job, rgb, rowstride);
+    }
+}
+
+/// Everything that decides the pixels of an image, to tell whether an
+/// interrupted export may be resumed
+std::string signature(Options const& op) {
+    std::ostringstream s;
+    s << std::setprecision(17) << (op.newton ? "newton" : "mandelbrot") << " center "
+      << op.center_x << ',' << op.center_y << " scale " << op.scale << " iters "
+      << op.iters << " algorithm " << int(op.algorithm) << " subdivide "
+      << op.subdivide << " precision " << int(op.precision) << " aa " << op.antialias
+      << ',' << op.antialias_threshold << " smooth " << op.channels.smooth;
+    if (auto const& trap = op.channels.trap) {
+        s << " trap " << trap->point.x() << ',' << trap->point.y();
+        if (trap->direction) s << ',' << trap->direction->x() << ',' << trap->direction->y();
+    }
+    if (op.newton) {
+        s << " poly";
+        for (auto const& c : op.poly) s << ' ' << c.real();
+    }
+    return s.str();
+}
+
+/// Render op.output as a tiled TIFF, holding one tile at a time
+void render_tiled(Options const& op, Viewport const& view, ThreadPool& tpool) {
+    TiledExport out(op.output, op.width, op.height, op.tile, signature(op));
+    int const count = out.tile_count();
+    if (out.resumed())
+        std::cerr << "Resuming with " << out.done_count() << " of " << count << " tiles done\n";
+
+    int const t = op.tile;
+    auto rgb    = untouched_buffer<std::uint8_t>(3ull * t * t);
+    MandelbrotEngine mandel(tpool);
+    NewtonEngine newton(tpool);
+    mandel.tile_cache().set_budget(0);  // no tile is seen twice
+
+    // Tiles differ only in their viewport, so the polynomial's roots are
+    // found once
+    NewtonJob newton_tile = op.newton ? newton_job(op, view, op.iters) : NewtonJob{};
+    MandelJob mandel_tile = mandel_job(op, view, op.iters);
+    newton_tile.width = newton_tile.height = t;
+    mandel_tile.width = mandel_tile.height = t;
+
+    auto beg = std::chrono::steady_clock::now();
+    for (int i = 0, reported = 0; i < count; ++i) {
+        if (out.done(i)) continue;
+        Viewport const v = view.shifted(vec2{out.tile_x(i), out.tile_y(i)});
+        if (op.newton) {
+            newton_tile.viewport = v;
+            newton.render(newton_tile, rgb.data(), 3 * t);
+        } else {
+            mandel_tile.viewport = v;
+            render_mandel(mandel, op, mandel_tile, rgb.data(), 3 * t, true);
+        }
+        out.write_tile(i, rgb);
+        if (int const percent = 100 * (i + 1) / count; percent >= reported + 5) {
+            std::cerr << "Tiles: " << percent << "%\n";
+            reported = percent;
+        }
+    }
+    out.finish();
+    std::chrono::duration<double, std::milli> const et = std::chrono::steady_clock::now() - beg;
+    std::cerr << "Render time: " << et.count() << " ms\n";
+}
+
+/// Render the animation of op.keyframes into op.output
+void render_keyframes(Options const& op, ThreadPool& tpool) {
+    std::ifstream in(op.keyframes);
+    if (!in) throw std::runtime_error("cannot open " + op.keyframes);
+    auto const keys  = parse_keyframes(in);
+    auto const views = interpolate_keyframes(keys);
+
+    std::ofstream file;
+    std::unique_ptr<FrameSink> sink;
+    if (op.output == "-" || op.output.ends_with(".y4m")) {
+        if (op.output != "-") {
+            file.open(op.output, std::ios::binary);
+            if (!file) throw std::runtime_error("cannot open " + op.output);
+        }
+        std::ostream& os = op.output == "-" ? std::cout : file;
+        sink = std::make_unique<Y4mStream>(os, op.width, op.height, op.fps);
+    } else {
+        sink = std::make_unique<ImageFiles>(
+            op.output, op.output.ends_with(".png") ? ImageFormat::PNG : ImageFormat::PPM);
+    }
+
+    // One frame computing and up to one colouring and encoding per worker
+    int const depth = std::min(op.threads, 8) + 1;
+    auto beg        = std::chrono::steady_clock::now();
+    if (op.newton) {
+        auto make_job = [&](Viewport const& v, int iters) { return newton_job(op, v, iters); };
+        render_animation<NewtonEngine>(tpool, views, op.width, op.height, make_job, *sink, depth);
+    } else {
+        auto make_job = [&](Viewport const& v, int iters) { return mandel_job(op, v, iters); };
+        render_animation<MandelbrotEngine>(tpool, views, op.width, op.height, make_job, *sink, depth);
+    }
+    std::chrono::duration<double> const et = std::chrono::steady_clock::now() - beg;
+    std::cerr << "Rendered " << views.size() << " frames in " << et.count() << " s, "
+              << views.size() * 3600 / et.count() << " frames/hour\n";
+}
+
+void write_ppm(std::ostream& os, std::span<std::uint8_t const> rgb, int w,
+               int h) {
+    os << "P6\n" << w << ' ' << h << "\n255\n";
+    os.write(reinterpret_cast<char const*>(rgb.data()), rgb.size());
+}
+
+/// Write the trace if one was asked for; false on failure
+bool write_trace(Options const& op) {
+    if (op.trace_file.empty()) return true;
+    std::ofstream trace_out(op.trace_file);
+    trace::write_chrome_trace(trace_out);
+    if (!trace_out) {
+        std::cerr << "fractal-render: failed to write " << op.trace_file << '\n';
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options op;
+    try {
+        op = parse_options(argc, argv);
+    } catch (std::exception const& e) {
+        std::cerr << "fractal-render: " << e.what() << "\n\n" << usage;
+        return 1;
+    }
+
+    trace::name_thread("main");
+    ThreadPool::configure_shared({.threads = op.threads, .pin = op.pin});
+    ThreadPool& tpool = ThreadPool::shared();
+
+    if (!op.keyframes.empty()) {
+        try {
+            render_keyframes(op, tpool);
+        } catch (std::exception const& e) {
+            std::cerr << "fractal-render: " << e.what() << '\n';
+            return 1;
+        }
+        return write_trace(op) ? 0 : 1;
+    }
+
+    PrecisePoint center;
+    try {
+        unsigned const bits = precision_for_scale(op.scale);
+        center = PrecisePoint(mpf_class(op.center_x, bits), mpf_class(op.center_y, bits));
+    } catch (std::invalid_argument const&) {
+        std::cerr << "fractal-render: invalid --center\n\n" << usage;
+        return 1;
+    }
+    Viewport const view = frame_viewport({center, op.scale, op.iters}, op.width, op.height);
+
+    if (tiled_output(op)) {
+        try {
+            render_tiled(op, view, tpool);
+        } catch (std::exception const& e) {
+            std::cerr << "fractal-render: " << e.what() << '\n';
+            return 1;
+        }
+        return write_trace(op) ? 0 : 1;
+    }
+
+    auto rgb = untouched_buffer<std::uint8_t>(3ull * op.width * op.height);
+
+    auto beg = std::chrono::steady_clock::now();
+    try {
+        if (op.newton) {
+            NewtonEngine(tpool).render(newton_job(op, view, op.iters), rgb.data(),
+                                       3 * op.width);
+        } else {
+            MandelJob const job = mandel_job(op, view, op.iters);
+            std::cerr << "Kernel: " << MandelbrotEngine::kernel_name(job) << '\n';
+            MandelbrotEngine engine(tpool);
+            render_mandel(engine, op, job, rgb.data(), 3 * op.width);
+        }
+    } catch (std::exception const& e) {
+        std::cerr << "fractal-render: " << e.what() << '\n';
+        return 1;
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> et = end - beg;
+    std::cerr << "Render time: " << et.count() << " ms\n";
+
+    if (!write_trace(op)) return 1;
+
+    if (op.output == "-") {
+        write_ppm(std::cout, rgb, op.width, op.height);
+        return std::cout ? 0 : 1;
+    }
+    std::ofstream out(op.output, std::ios::binary);
+    write_ppm(out, rgb, op.width, op.height);
+    if (!out) {
+        std::cerr << "fractal-render: failed to write " << op.output << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <simd_kernels.hpp>
+
+#include <stdexcept>
+#include <string>
+
+DoubleDouble operator+(DoubleDouble a, double b) {
+    // Two-sum of the high parts, then the low part joins the error
+    double const s  = a.hi + b;
+    double const bb = s - a.hi;
+    double const e  = (a.hi - (s - bb)) + (b - bb) + a.lo;
+    double const hi = s + e;
+    return {hi, e - (hi - s)};
+}
+
+SimdLevel detected_simd_level() {
+    // __builtin_cpu_supports also checks that the OS saves the wider
+    // registers, not just the CPUID bits
+    static SimdLevel const level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+            return SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return SimdLevel::AVX2;
+        return SimdLevel::SSE2;
+    }();
+    return level;
+}
+
+char const* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::SSE2: return "SSE2";
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::AVX512: return "AVX-512";
+    }
+    return "unknown";
+}
+
+line_kernel* line_kernel_for(SimdLevel level, bool single) {
+    if (level > detected_simd_level())
+        throw std::invalid_argument(std::string(simd_level_name(level))
+                                    + " is not supported by this CPU");
+    switch (level) {
+    case SimdLevel::SSE2: return single ? &sse2_render_line_float : &sse2_render_line;
+    case SimdLevel::AVX2: return single ? &avx2_render_line_float : &avx2_render_line;
+    case SimdLevel::AVX512:
+        return single ? &avx512_render_line_float : &avx512_render_line;
+    }
+    throw std::invalid_argument("unknown SIMD level");
+}
+
+dd_line_kernel* dd_line_kernel_for(SimdLevel level) {
+    if (level > detected_simd_level())
+        throw std::invalid_argument(std::string(simd_level_name(level))
+                                    + " is not supported by this CPU");
+    switch (level) {
+    case SimdLevel::SSE2: return &sse2_render_line_dd;
+    case SimdLevel::AVX2: return &avx2_render_line_dd;
+    case SimdLevel::AVX512: return &avx512_render_line_dd;
+    }
+    throw std::invalid_argument("unknown SIMD level");
+}
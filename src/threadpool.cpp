@@ -0,0 +1,54 @@
+#include <threadpool.hpp>
+
+#include <stdexcept>
+
+namespace {
+
+std::mutex shared_mtx;
+PoolOptions shared_options;
+bool shared_started = false;
+
+}  // namespace
+
+ThreadPool::ThreadPool(PoolOptions const& opts)
+    : workers(std::max(opts.threads, 0)), worker_node(workers, 0),
+      deques(new std::array<WorkDeque, lanes>[std::max(workers, 1)]) {
+    // CPUs for the workers, one per node in turn, so that a pool smaller
+    // than the machine still spans every node's memory
+    std::vector<int> cpus;
+    auto const& topo = cpu_topology();
+    if (opts.pin) {
+        for (std::size_t j = 0; int(cpus.size()) < topo.cpu_count(); ++j) {
+            for (auto const& node : topo.nodes) {
+                if (j < node.size()) cpus.push_back(node[j]);
+            }
+        }
+    }
+
+    std::vector<int> worker_cpu(workers, -1);
+    for (int i = 0; i < workers && !cpus.empty(); ++i) {
+        worker_cpu[i]  = cpus[i % cpus.size()];
+        worker_node[i] = topo.node_of(worker_cpu[i]);
+    }
+
+    // Every placement is in before a worker can read one
+    threads.reserve(workers);
+    for (int i = 0; i < workers; ++i)
+        threads.push_back(std::thread(&ThreadPool::thread_func, this, i, worker_cpu[i]));
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool([] {
+        std::lock_guard g(shared_mtx);
+        shared_started = true;
+        return shared_options;
+    }());
+    return pool;
+}
+
+void ThreadPool::configure_shared(PoolOptions const& opts) {
+    std::lock_guard g(shared_mtx);
+    if (shared_started)
+        throw std::logic_error("the shared thread pool has already started");
+    shared_options = opts;
+}
@@ -0,0 +1,111 @@
+#include <tile_cache.hpp>
+
+#include <cmath>
+#include <functional>
+
+std::size_t TileKeyHash::operator()(TileKey const& k) const noexcept {
+    std::size_t h = std::hash<double>{}(k.scale);
+    auto mix      = [&h](std::size_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    };
+    mix(std::hash<int>{}(k.max_iters));
+    mix(static_cast<std::size_t>(k.algorithm) * 2 + k.subdivide);
+    mix(static_cast<std::size_t>(k.precision));
+    mix(std::hash<std::int64_t>{}(k.x));
+    mix(std::hash<std::int64_t>{}(k.y));
+    return h;
+}
+
+std::optional<std::array<std::int64_t, 2>> grid_origin(Viewport const& v) {
+    // Beyond this doubles cannot address the pixels any more
+    constexpr double limit = 1ll << 52;
+    constexpr double tol   = 1e-3;
+
+    double px, py;
+    if (v.precise_top_left) {
+        mpf_class const x = v.precise_top_left->x * v.scale;
+        mpf_class const y = v.precise_top_left->y * v.scale;
+        mpf_class const rx = floor(x + 0.5);
+        mpf_class const ry = floor(y + 0.5);
+        if (abs(x - rx) > tol || abs(y - ry) > tol) return std::nullopt;
+        px = rx.get_d();
+        py = ry.get_d();
+    } else {
+        double const x = v.top_left.x() * v.scale;
+        double const y = v.top_left.y() * v.scale;
+        px = std::round(x);
+        py = std::round(y);
+        if (std::abs(x - px) > tol || std::abs(y - py) > tol) return std::nullopt;
+    }
+    if (std::abs(px) >= limit || std::abs(py) >= limit) return std::nullopt;
+    return std::array{static_cast<std::int64_t>(px), static_cast<std::int64_t>(py)};
+}
+
+std::size_t TileCache::cost(Tile const& t) {
+    return t->size() * sizeof(int) + sizeof(Entry) + sizeof(std::vector<int>);
+}
+
+auto TileCache::find(TileKey const& key) -> Tile {
+    std::lock_guard g(mtx);
+    auto it = index.find(key);
+    if (it == index.end()) {
+        ++counters.misses;
+        return nullptr;
+    }
+    ++counters.hits;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->second;
+}
+
+void TileCache::insert(TileKey const& key, std::vector<int> tile) {
+    auto t = std::make_shared<std::vector<int> const>(std::move(tile));
+    std::lock_guard g(mtx);
+    if (budget == 0) return;
+
+    if (auto it = index.find(key); it != index.end()) {
+        used -= cost(it->second->second);
+        lru.erase(it->second);
+        index.erase(it);
+    }
+    used += cost(t);
+    lru.emplace_front(key, std::move(t));
+    index.emplace(key, lru.begin());
+    evict();
+}
+
+void TileCache::evict() {
+    while (used > budget && !lru.empty()) {
+        used -= cost(lru.back().second);
+        index.erase(lru.back().first);
+        lru.pop_back();
+        ++counters.evictions;
+    }
+}
+
+void TileCache::set_budget(std::size_t bytes) {
+    std::lock_guard g(mtx);
+    budget = bytes;
+    evict();
+}
+
+std::size_t TileCache::get_budget() const {
+    std::lock_guard g(mtx);
+    return budget;
+}
+
+std::size_t TileCache::memory_used() const {
+    std::lock_guard g(mtx);
+    return used;
+}
+
+void TileCache::clear() {
+    std::lock_guard g(mtx);
+    lru.clear();
+    index.clear();
+    used = 0;
+}
+
+auto TileCache::stats() const -> Stats {
+    std::lock_guard g(mtx);
+    return counters;
+}
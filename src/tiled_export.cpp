@@ -0,0 +1,207 @@
+#include <tiled_export.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::system_error io_error(std::string const& what, std::string const& path) {
+    return std::system_error(errno, std::generic_category(), what + " " + path);
+}
+
+void write_at(int fd, void const* data, std::size_t n, std::uint64_t offset,
+              std::string const& path) {
+    auto const* p = static_cast<char const*>(data);
+    while (n > 0) {
+        ssize_t const k = ::pwrite(fd, p, n, offset);
+        if (k < 0 && errno == EINTR) continue;
+        if (k < 0) throw io_error("cannot write", path);
+        p += k;
+        n -= k;
+        offset += k;
+    }
+}
+
+/// Append v as `bytes` little-endian bytes
+void put(std::string& s, std::uint64_t v, int bytes) {
+    for (int k = 0; k < bytes; ++k) s += char(v >> 8 * k & 0xff);
+}
+
+/// BigTIFF header, the directory of the one image and its tile tables. Sets
+/// `data_offset` to the page-aligned start of the tiles.
+std::string tiff_header(int w, int h, int tile, int count, std::uint64_t& data_offset) {
+    enum : std::uint16_t { SHORT = 3, LONG = 4, LONG8 = 16 };
+    struct Entry {
+        std::uint16_t tag, type;
+        std::uint64_t count, value;  // the value itself when it fits in 8 bytes
+    };
+    constexpr std::uint64_t entries = 11;
+    constexpr std::uint64_t ifd     = 16;
+    std::uint64_t const offsets_at  = ifd + 8 + entries * 20 + 8;
+    std::uint64_t const counts_at   = offsets_at + 8ull * count;
+    std::uint64_t const tile_bytes  = 3ull * tile * tile;
+    data_offset = (counts_at + 8ull * count + 4095) / 4096 * 4096;
+
+    std::array<Entry, entries> const dir = {{
+        {256, LONG, 1, std::uint64_t(w)},           // ImageWidth
+        {257, LONG, 1, std::uint64_t(h)},           // ImageLength
+        {258, SHORT, 3, 8 | 8 << 16 | 8ull << 32},  // BitsPerSample
+        {259, SHORT, 1, 1},                         // Compression: none
+        {262, SHORT, 1, 2},                         // Photometric: RGB
+        {277, SHORT, 1, 3},                         // SamplesPerPixel
+        {284, SHORT, 1, 1},                         // PlanarConfiguration: chunky
+        {322, LONG, 1, std::uint64_t(tile)},        // TileWidth
+        {323, LONG, 1, std::uint64_t(tile)},        // TileLength
+        {324, LONG8, std::uint64_t(count), count == 1 ? data_offset : offsets_at},
+        {325, LONG8, std::uint64_t(count), count == 1 ? tile_bytes : counts_at},
+    }};
+
+    std::string s = "II";
+    put(s, 43, 2);  // BigTIFF
+    put(s, 8, 2);   // offset size
+    put(s, 0, 2);
+    put(s, ifd, 8);
+    put(s, entries, 8);
+    for (Entry const& e : dir) {
+        put(s, e.tag, 2);
+        put(s, e.type, 2);
+        put(s, e.count, 8);
+        put(s, e.value, 8);
+    }
+    put(s, 0, 8);  // no further images
+    for (int i = 0; i < count; ++i) put(s, data_offset + i * tile_bytes, 8);
+    for (int i = 0; i < count; ++i) put(s, tile_bytes, 8);
+    return s;
+}
+
+}  // namespace
+
+TiledExport::TiledExport(std::string path_, int w, int h, int tile_,
+                         std::string const& signature)
+    : path(std::move(path_)), width(w), height(h), tile(tile_) {
+    if (w <= 0 || h <= 0) throw std::invalid_argument("image size must be positive");
+    if (tile <= 0 || tile % 16)
+        throw std::invalid_argument("tile size must be a positive multiple of 16");
+    columns = (w + tile - 1) / tile;
+    rows    = (h + tile - 1) / tile;
+    if (std::int64_t(columns) * rows > 1 << 30)
+        throw std::invalid_argument("too many tiles");
+
+    // Everything that decides the pixels, on one line
+    std::string line = signature;
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    line = "fractal tiles " + std::to_string(w) + "x" + std::to_string(h) + " "
+           + std::to_string(tile) + " " + line + "\n";
+    last_checkpoint = std::chrono::steady_clock::now();
+    try {
+        if (!resume(line)) create(line);
+    } catch (...) {
+        if (fd >= 0) ::close(fd);
+        if (progress_fd >= 0) ::close(progress_fd);
+        throw;
+    }
+}
+
+TiledExport::~TiledExport() {
+    if (fd < 0) return;
+    try {
+        checkpoint();
+    } catch (std::exception const&) {
+        // The unrecorded tiles are rendered again on resume
+    }
+    ::close(fd);
+    ::close(progress_fd);
+}
+
+bool TiledExport::resume(std::string const& header) {
+    std::string const progress_path = path + ".progress";
+    int const pfd = ::open(progress_path.c_str(), O_RDWR);
+    if (pfd < 0) return false;
+
+    std::string contents(header.size() + tile_count(), '\0');
+    ssize_t const n = ::pread(pfd, contents.data(), contents.size(), 0);
+    struct stat st;
+    bool const ok = n == ssize_t(contents.size()) && ::fstat(pfd, &st) == 0
+                    && std::uint64_t(st.st_size) == contents.size()
+                    && contents.compare(0, header.size(), header) == 0
+                    && std::all_of(contents.begin() + header.size(), contents.end(),
+                                   [](char c) { return c == '0' || c == '1'; });
+    int const dfd = ok ? ::open(path.c_str(), O_RDWR) : -1;
+    std::uint64_t offset = 0;
+    tiff_header(width, height, tile, tile_count(), offset);
+    if (dfd < 0 || ::fstat(dfd, &st) != 0
+        || std::uint64_t(st.st_size) != offset + 3ull * tile * tile * tile_count()) {
+        if (dfd >= 0) ::close(dfd);
+        ::close(pfd);
+        return false;
+    }
+
+    fd              = dfd;
+    progress_fd     = pfd;
+    data_offset     = offset;
+    progress_header = header.size();
+    finished.assign(contents.begin() + header.size(), contents.end());
+    resumed_ = true;
+    return true;
+}
+
+void TiledExport::create(std::string const& header) {
+    std::string const tiff = tiff_header(width, height, tile, tile_count(), data_offset);
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw io_error("cannot create", path);
+    write_at(fd, tiff.data(), tiff.size(), 0, path);
+    // Sparse until the tiles arrive
+    if (::ftruncate(fd, data_offset + 3ull * tile * tile * tile_count()) != 0)
+        throw io_error("cannot size", path);
+
+    std::string const progress_path = path + ".progress";
+    progress_fd = ::open(progress_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (progress_fd < 0) throw io_error("cannot create", progress_path);
+    finished.assign(tile_count(), '0');
+    std::string const contents = header + std::string(finished.begin(), finished.end());
+    write_at(progress_fd, contents.data(), contents.size(), 0, progress_path);
+    progress_header = header.size();
+}
+
+int TiledExport::done_count() const {
+    return std::count(finished.begin(), finished.end(), '1');
+}
+
+void TiledExport::write_tile(int i, std::span<std::uint8_t const> rgb) {
+    std::uint64_t const tile_bytes = 3ull * tile * tile;
+    if (i < 0 || i >= tile_count() || rgb.size() != tile_bytes)
+        throw std::invalid_argument("no such tile, or not a whole one");
+    write_at(fd, rgb.data(), rgb.size(), data_offset + i * tile_bytes, path);
+    finished[i] = '1';
+    unrecorded.push_back(i);
+    if (std::chrono::steady_clock::now() - last_checkpoint >= checkpoint_interval)
+        checkpoint();
+}
+
+void TiledExport::checkpoint() {
+    last_checkpoint = std::chrono::steady_clock::now();
+    if (unrecorded.empty()) return;
+    // A tile is only recorded once its pixels cannot be lost
+    if (::fsync(fd) != 0) throw io_error("cannot sync", path);
+    std::string const progress_path = path + ".progress";
+    for (int i : unrecorded)
+        write_at(progress_fd, "1", 1, progress_header + i, progress_path);
+    if (::fsync(progress_fd) != 0) throw io_error("cannot sync", progress_path);
+    unrecorded.clear();
+}
+
+void TiledExport::finish() {
+    checkpoint();
+    ::close(fd);
+    ::close(progress_fd);
+    fd = progress_fd = -1;
+    std::string const progress_path = path + ".progress";
+    ::unlink(progress_path.c_str());
+}
@@ -0,0 +1,135 @@
+#include <topology.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/// CPUs of a sysfs list such as "0-3,8,10-11"
+std::set<int> parse_cpu_list(std::string_view s) {
+    std::set<int> cpus;
+    while (!s.empty()) {
+        auto const comma = s.find(',');
+        std::string_view item = s.substr(0, comma);
+        s = comma == std::string_view::npos ? "" : s.substr(comma + 1);
+
+        int lo = 0, hi = 0;
+        auto [end, ec] = std::from_chars(item.data(), item.data() + item.size(), lo);
+        if (ec != std::errc{}) continue;
+        hi = lo;
+        if (end != item.data() + item.size() && *end == '-')
+            std::from_chars(end + 1, item.data() + item.size(), hi);
+        for (int c = lo; c <= hi; ++c) cpus.insert(c);
+    }
+    return cpus;
+}
+
+std::set<int> allowed_cpus() {
+    std::set<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (CPU_ISSET(c, &set)) cpus.insert(c);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        for (int c = 0; c < int(std::max(1u, std::thread::hardware_concurrency())); ++c)
+            cpus.insert(c);
+    }
+    return cpus;
+}
+
+CpuTopology detect_topology() {
+    std::set<int> allowed = allowed_cpus();
+    CpuTopology topo;
+
+    // Nodes by number, each with the allowed CPUs of its cpulist
+    std::map<int, std::vector<int>> nodes;
+    std::error_code ec;
+    for (auto const& e : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+        std::string const name = e.path().filename();
+        int id = 0;
+        if (!name.starts_with("node")
+            || std::from_chars(name.data() + 4, name.data() + name.size(), id).ec != std::errc{})
+            continue;
+        std::ifstream in(e.path() / "cpulist");
+        std::string list;
+        std::getline(in, list);
+        for (int c : parse_cpu_list(list)) {
+            if (allowed.erase(c)) nodes[id].push_back(c);
+        }
+    }
+    for (auto& [id, cpus] : nodes) {
+        if (!cpus.empty()) topo.nodes.push_back(std::move(cpus));
+    }
+    // CPUs sysfs did not place, or everything when there is no sysfs
+    if (!allowed.empty()) {
+        if (topo.nodes.empty()) topo.nodes.emplace_back();
+        topo.nodes.front().insert(topo.nodes.front().end(), allowed.begin(), allowed.end());
+        std::sort(topo.nodes.front().begin(), topo.nodes.front().end());
+    }
+    return topo;
+}
+
+}  // namespace
+
+int CpuTopology::cpu_count() const {
+    int n = 0;
+    for (auto const& node : nodes) n += node.size();
+    return n;
+}
+
+int CpuTopology::node_of(int cpu) const {
+    for (int i = 0; i < int(nodes.size()); ++i) {
+        if (std::find(nodes[i].begin(), nodes[i].end(), cpu) != nodes[i].end()) return i;
+    }
+    return -1;
+}
+
+CpuTopology const& cpu_topology() {
+    static CpuTopology const topo = detect_topology();
+    return topo;
+}
+
+bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+void release_pages(void* p, std::size_t bytes) {
+#ifdef __linux__
+    static std::size_t const page = sysconf(_SC_PAGESIZE);
+    auto const beg = (reinterpret_cast<std::uintptr_t>(p) + page - 1) / page * page;
+    auto const end = (reinterpret_cast<std::uintptr_t>(p) + bytes) / page * page;
+    if (end > beg) madvise(reinterpret_cast<void*>(beg), end - beg, MADV_DONTNEED);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
@@ -0,0 +1,211 @@
+#include <trace.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace trace {
+
+namespace {
+
+#ifdef FRACTAL_TRACING
+
+/// Events each thread keeps; older ones are overwritten
+constexpr std::size_t log_capacity = 1 << 14;
+
+struct ThreadLog {
+    std::mutex mtx;  // only contended while events are collected
+    int id = 0;
+    std::string name;
+    std::vector<Event> ring;
+    std::size_t written = 0;
+};
+
+std::mutex registry_mtx;
+// Logs outlive their threads, so events of finished threads stay readable
+std::vector<std::unique_ptr<ThreadLog>> logs;
+
+ThreadLog& this_log() {
+    thread_local ThreadLog* const log = [] {
+        std::lock_guard g(registry_mtx);
+        auto& l = logs.emplace_back(std::make_unique<ThreadLog>());
+        l->id   = logs.size() - 1;
+        l->name = "thread " + std::to_string(l->id);
+        l->ring.resize(log_capacity);
+        return l.get();
+    }();
+    return *log;
+}
+
+/// Write `s` as a JSON string
+void write_string(std::ostream& os, std::string_view s) {
+    os << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') os << '\\';
+        os << c;
+    }
+    os << '"';
+}
+
+#endif
+
+}  // namespace
+
+#ifdef FRACTAL_TRACING
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+Span::Span(char const* name, char const* category)
+    : ev{name, category, now_ns(), 0, 0, {}} {}
+
+Span::~Span() {
+    ThreadLog& log = this_log();
+    ev.duration_ns = now_ns() - ev.start_ns;
+    ev.thread      = log.id;
+    std::lock_guard g(log.mtx);
+    log.ring[log.written++ % log_capacity] = ev;
+}
+
+void Span::arg(char const* name, std::int64_t value) {
+    auto& slot = ev.args[ev.args[0].first ? 1 : 0];
+    slot       = {name, value};
+}
+
+void name_thread(std::string_view name, int index) {
+    ThreadLog& log = this_log();
+    std::string full(name);
+    if (index >= 0) full += ' ' + std::to_string(index);
+    std::lock_guard g(log.mtx);
+    log.name = std::move(full);
+}
+
+std::vector<Event> events_since(std::int64_t t0) {
+    std::vector<Event> res;
+    std::lock_guard g(registry_mtx);
+    for (auto const& log : logs) {
+        std::lock_guard lg(log->mtx);
+        std::size_t const n = std::min(log->written, log_capacity);
+        for (std::size_t i = log->written - n; i < log->written; ++i) {
+            Event const& ev = log->ring[i % log_capacity];
+            if (ev.start_ns >= t0) res.push_back(ev);
+        }
+    }
+    return res;
+}
+
+void clear() {
+    std::lock_guard g(registry_mtx);
+    for (auto const& log : logs) {
+        std::lock_guard lg(log->mtx);
+        log->written = 0;
+    }
+}
+
+#endif
+
+void write_chrome_trace(std::ostream& os) {
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+#ifdef FRACTAL_TRACING
+    bool first = true;
+    auto sep   = [&] {
+        if (!first) os << ",\n";
+        first = false;
+    };
+    {
+        std::lock_guard g(registry_mtx);
+        for (auto const& log : logs) {
+            std::lock_guard lg(log->mtx);
+            sep();
+            os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << log->id
+               << ",\"args\":{\"name\":";
+            write_string(os, log->name);
+            os << "}}";
+        }
+    }
+    for (Event const& ev : events_since()) {
+        sep();
+        os << "{\"name\":";
+        write_string(os, ev.name);
+        os << ",\"cat\":";
+        write_string(os, ev.category);
+        os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ev.thread
+           << ",\"ts\":" << ev.start_ns / 1e3 << ",\"dur\":" << ev.duration_ns / 1e3
+           << ",\"args\":{";
+        for (int k = 0; k < 2 && ev.args[k].first; ++k) {
+            if (k) os << ',';
+            write_string(os, ev.args[k].first);
+            os << ':' << ev.args[k].second;
+        }
+        os << "}}";
+    }
+#endif
+    os << "]}\n";
+}
+
+FrameStats summarize(std::span<Event const> events, std::int64_t t0,
+                     std::int64_t t1, int threads) {
+    FrameStats stats;
+    std::map<int, std::vector<Event const*>> phases, busy;
+    for (Event const& ev : events) {
+        if (std::strcmp(ev.category, phase) == 0) phases[ev.thread].push_back(&ev);
+        if (std::strcmp(ev.category, work) == 0) busy[ev.thread].push_back(&ev);
+    }
+    auto by_start = [](Event const* a, Event const* b) {
+        return a->start_ns < b->start_ns
+               || (a->start_ns == b->start_ns && a->duration_ns > b->duration_ns);
+    };
+
+    // Exclusive time: each span less the spans nested in it on its thread
+    auto add = [&](char const* name, double ms) {
+        auto it = std::find_if(stats.phase_ms.begin(), stats.phase_ms.end(),
+                               [&](auto const& p) { return std::strcmp(p.first, name) == 0; });
+        if (it == stats.phase_ms.end())
+            stats.phase_ms.emplace_back(name, ms);
+        else
+            it->second += ms;
+    };
+    std::vector<Event const*> order;
+    for (auto& [thread, evs] : phases) order.insert(order.end(), evs.begin(), evs.end());
+    std::stable_sort(order.begin(), order.end(), by_start);
+    for (Event const* ev : order) add(ev->name, 0);
+    for (auto& [thread, evs] : phases) {
+        std::sort(evs.begin(), evs.end(), by_start);
+        std::vector<Event const*> open;
+        for (Event const* ev : evs) {
+            while (!open.empty()
+                   && open.back()->start_ns + open.back()->duration_ns <= ev->start_ns)
+                open.pop_back();
+            if (!open.empty()) add(open.back()->name, -ev->duration_ns / 1e6);
+            add(ev->name, ev->duration_ns / 1e6);
+            open.push_back(ev);
+        }
+    }
+
+    // Busy time per thread, with overlapping (nested) spans merged
+    if (t1 > t0 && threads > 0) {
+        double total = 0;
+        for (auto& [thread, evs] : busy) {
+            std::sort(evs.begin(), evs.end(), by_start);
+            std::int64_t covered = t0;
+            for (Event const* ev : evs) {
+                std::int64_t const b = std::max(ev->start_ns, covered);
+                std::int64_t const e = std::min(ev->start_ns + ev->duration_ns, t1);
+                if (e > b) total += e - b;
+                covered = std::max(covered, e);
+            }
+        }
+        stats.utilization = total / (double(t1 - t0) * threads);
+    }
+    return stats;
+}
+
+}  // namespace trace